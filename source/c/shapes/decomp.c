@@ -8,6 +8,7 @@
 #include <mpi.h>
 #include "decomp.h"
 #include "mpivars.h"
+#include "../../common/block-decomp.h"
 
 /* random integer from {minv, minv+1, ..., maxv}
  including minv and maxv */
@@ -49,17 +50,10 @@ void gather_decomp_1d( long long int *mysize, long long int *myshape, long long
 void decomp_1d(long long int globalsize, long long int *myoffset,
                   long long int *mysize)
 {
-    long long int rem;
-    *mysize = globalsize / nproc;
-    rem = globalsize - (nproc * *mysize);
-    if (rank < rem)
-    {
-        mysize = mysize + 1;
-        *myoffset = rank * *mysize;
-    }
-    else
-    {
-        *myoffset = rank * *mysize + rem;
-    }
+    size_t start, count;
+    decomp_block_1d((size_t)globalsize, (size_t)nproc, (size_t)rank, &start,
+                    &count);
+    *myoffset = (long long int)start;
+    *mysize = (long long int)count;
     return;
 }
@@ -0,0 +1,159 @@
+//
+// Checks of the block decomposition helpers on the edge cases the examples
+// run into: more parts than indices, empty writer layouts, uneven costs
+//
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "block-decomp.hpp"
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+static std::string case_name(const char *fn, std::size_t n, std::size_t nparts)
+{
+    return std::string(fn) + " n=" + std::to_string(n) +
+           " nparts=" + std::to_string(nparts);
+}
+
+// The blocks cover [0, n) in order, remainder-balanced, and owner_1d finds
+// the block of every index
+static void test_block_owner(std::size_t n, std::size_t nparts)
+{
+    std::size_t next = 0;
+    for (std::size_t p = 0; p < nparts; ++p)
+    {
+        std::size_t start, count;
+        decomp::block_1d(n, nparts, p, start, count);
+        const std::string name = case_name("block_1d", n, nparts) +
+                                 " part=" + std::to_string(p);
+        check(start == next, name + " is contiguous");
+        check(count == n / nparts + (p < n % nparts ? 1 : 0),
+              name + " is remainder-balanced");
+        for (std::size_t i = start; i < start + count; ++i)
+        {
+            check(decomp::owner_1d(n, nparts, i) == p,
+                  case_name("owner_1d", n, nparts) +
+                      " i=" + std::to_string(i));
+        }
+        next = start + count;
+    }
+    check(next == n, case_name("block_1d", n, nparts) + " covers n");
+
+    // Outside [0, n) there is no owner, also when n < nparts
+    check(decomp::owner_1d(n, nparts, n) == nparts,
+          case_name("owner_1d", n, nparts) + " past the end");
+}
+
+static void test_block_edges()
+{
+    std::size_t start, count;
+    decomp::block_1d(10, 0, 0, start, count);
+    check(start == 10 && count == 0, "block_1d without parts is empty");
+    decomp::block_1d(10, 3, 3, start, count);
+    check(start == 10 && count == 0, "block_1d past the last part is empty");
+    check(decomp::owner_1d(10, 0, 5) == 0, "owner_1d without parts");
+}
+
+static void test_bounds()
+{
+    // Unsorted, duplicated and out of range starts
+    const std::vector<std::size_t> b = decomp::bounds(10, {5, 0, 5, 12});
+    check(b == std::vector<std::size_t>({0, 5, 10}), "bounds_1d deduplicates");
+
+    // No writer block, and none starting at the origin
+    check(decomp::bounds(10, {}) == std::vector<std::size_t>({0, 10}),
+          "bounds_1d without starts");
+    check(decomp::bounds(10, {4}) == std::vector<std::size_t>({0, 4, 10}),
+          "bounds_1d adds the origin");
+}
+
+static void test_aligned()
+{
+    // Three writer blocks over two readers, whole blocks each
+    const std::vector<std::size_t> b = {0, 3, 5, 10};
+    std::size_t start, count;
+    decomp::aligned_1d(b, 2, 0, start, count);
+    check(start == 0 && count == 5, "aligned_1d part 0");
+    decomp::aligned_1d(b, 2, 1, start, count);
+    check(start == 5 && count == 5, "aligned_1d part 1");
+
+    // Fewer writer blocks than readers fall back to block_1d
+    const std::vector<std::size_t> one = {0, 10};
+    for (std::size_t p = 0; p < 3; ++p)
+    {
+        std::size_t s, c;
+        decomp::aligned_1d(one, 3, p, start, count);
+        decomp::block_1d(10, 3, p, s, c);
+        check(start == s && count == c,
+              "aligned_1d fallback part " + std::to_string(p));
+    }
+}
+
+// Increasing bounds from 0 to n, every part non-empty when n >= nparts
+static void check_weighted(const std::vector<double> &cost, std::size_t nparts,
+                           const std::string &name)
+{
+    const std::vector<std::size_t> b = decomp::weighted_1d(cost, nparts);
+    check(b.size() == nparts + 1 && b.front() == 0 && b.back() == cost.size(),
+          name + " spans [0, n)");
+    for (std::size_t p = 0; p + 1 < b.size(); ++p)
+    {
+        check(cost.size() < nparts ? b[p] <= b[p + 1] : b[p] < b[p + 1],
+              name + " part " + std::to_string(p));
+    }
+}
+
+static void test_weighted()
+{
+    check(decomp::weighted_1d(std::vector<double>(9, 1.0), 3) ==
+              std::vector<std::size_t>({0, 3, 6, 9}),
+          "weighted_1d uniform cost");
+    check(decomp::weighted_1d({1.0, 1.0, 1.0, 1.0, 4.0}, 2) ==
+              std::vector<std::size_t>({0, 4, 5}),
+          "weighted_1d balances the cost");
+
+    // All the cost in one index, no cost at all, more parts than indices
+    check_weighted({0.0, 0.0, 10.0, 0.0, 0.0}, 3, "weighted_1d one hot index");
+    check_weighted(std::vector<double>(7, 0.0), 3, "weighted_1d zero cost");
+    check_weighted({1.0, 2.0}, 4, "weighted_1d n < nparts");
+    check(decomp::weighted_1d({1.0, 2.0}, 4) ==
+              std::vector<std::size_t>({0, 1, 2, 2, 2}),
+          "weighted_1d n < nparts falls back to block_1d");
+}
+
+int main()
+{
+    const std::size_t sizes[] = {0, 1, 2, 7, 10, 64};
+    const std::size_t parts[] = {1, 2, 3, 4, 8, 11};
+    for (const std::size_t n : sizes)
+    {
+        for (const std::size_t nparts : parts)
+        {
+            test_block_owner(n, nparts);
+        }
+    }
+    test_block_edges();
+    test_bounds();
+    test_aligned();
+    test_weighted();
+
+    if (failures)
+    {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "block decomposition checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,159 @@
+//
+// Block decomposition helpers shared by the C and C++ examples
+//
+#include "block-decomp.h"
+
+#include <stdlib.h>
+
+void decomp_block_1d(size_t n, size_t nparts, size_t part, size_t *start,
+                     size_t *count)
+{
+    size_t base, rem;
+    if (nparts == 0 || part >= nparts)
+    {
+        *start = n;
+        *count = 0;
+        return;
+    }
+    base = n / nparts;
+    rem = n % nparts;
+    *count = base + (part < rem ? 1 : 0);
+    *start = base * part + (part < rem ? part : rem);
+}
+
+size_t decomp_owner_1d(size_t n, size_t nparts, size_t i)
+{
+    size_t base, rem;
+    if (nparts == 0)
+    {
+        return 0;
+    }
+    /* past the end, and with n < nparts the only way to get base == 0 */
+    if (i >= n)
+    {
+        return nparts;
+    }
+    base = n / nparts;
+    rem = n % nparts;
+    /* the first rem parts are one element longer */
+    if (i < rem * (base + 1))
+    {
+        return i / (base + 1);
+    }
+    return rem + (i - rem * (base + 1)) / base;
+}
+
+void decomp_block_nd(int ndims, const size_t *shape, const size_t *nparts,
+                     const size_t *coords, size_t *start, size_t *count)
+{
+    int d;
+    for (d = 0; d < ndims; d++)
+    {
+        decomp_block_1d(shape[d], nparts[d], coords[d], &start[d], &count[d]);
+    }
+}
+
+void decomp_ghost_nd(int ndims, const size_t *shape, const int *periodic,
+                     size_t lo, size_t hi, size_t *start, size_t *count)
+{
+    int d;
+    for (d = 0; d < ndims; d++)
+    {
+        size_t first = start[d];
+        size_t last = start[d] + count[d];
+        if (periodic && periodic[d])
+        {
+            count[d] += lo + hi;
+            continue;
+        }
+        first = (first > lo) ? first - lo : 0;
+        last = (last + hi < shape[d]) ? last + hi : shape[d];
+        start[d] = first;
+        count[d] = last - first;
+    }
+}
+
+void decomp_aligned_1d(size_t nblocks, const size_t *bounds, size_t nparts,
+                       size_t part, size_t *start, size_t *count)
+{
+    size_t n = bounds[nblocks];
+    size_t bstart, bcount;
+    if (nblocks < nparts)
+    {
+        decomp_block_1d(n, nparts, part, start, count);
+        return;
+    }
+    decomp_block_1d(nblocks, nparts, part, &bstart, &bcount);
+    *start = bounds[bstart];
+    *count = bounds[bstart + bcount] - bounds[bstart];
+}
+
+static int compare_size(const void *a, const void *b)
+{
+    const size_t x = *(const size_t *)a;
+    const size_t y = *(const size_t *)b;
+    return (x > y) - (x < y);
+}
+
+size_t decomp_bounds_1d(size_t n, size_t nstarts, const size_t *starts,
+                        size_t *bounds)
+{
+    size_t i, nb = 0;
+    /* the origin is always a boundary, even if no writer block starts there */
+    bounds[0] = 0;
+    for (i = 0; i < nstarts; i++)
+    {
+        bounds[i + 1] = starts[i];
+    }
+    qsort(bounds, nstarts + 1, sizeof(size_t), compare_size);
+    /* unique, and drop anything outside [0, n) */
+    for (i = 0; i < nstarts + 1; i++)
+    {
+        if (bounds[i] >= n || (nb > 0 && bounds[i] == bounds[nb - 1]))
+        {
+            continue;
+        }
+        bounds[nb++] = bounds[i];
+    }
+    bounds[nb] = n;
+    return nb;
+}
+
+void decomp_weighted_1d(size_t n, const double *cost, size_t nparts,
+                        size_t *bounds)
+{
+    size_t i, p;
+    double total = 0.0, acc = 0.0;
+    for (i = 0; i < n; i++)
+    {
+        total += cost[i];
+    }
+    if (n < nparts || total <= 0.0)
+    {
+        size_t count;
+        for (p = 0; p < nparts; p++)
+        {
+            decomp_block_1d(n, nparts, p, &bounds[p], &count);
+        }
+        bounds[nparts] = n;
+        return;
+    }
+
+    i = 0;
+    bounds[0] = 0;
+    for (p = 1; p < nparts; p++)
+    {
+        const double target = total * p / nparts;
+        /* leave at least one index for this and every following part */
+        const size_t lo = bounds[p - 1] + 1;
+        const size_t hi = n - (nparts - p);
+        /* take an index while its midpoint is below the target */
+        while (i < hi && (i < lo || acc + 0.5 * cost[i] < target))
+        {
+            acc += cost[i];
+            i++;
+        }
+        bounds[p] = i;
+    }
+    bounds[nparts] = n;
+}
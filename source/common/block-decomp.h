@@ -0,0 +1,63 @@
+//
+// Block decomposition helpers shared by the C and C++ examples
+//
+// All functions split a global index space [0, n) into contiguous blocks.
+// The split is remainder-balanced: the first (n % nparts) parts receive one
+// extra element, which is the same layout the Gray-Scott simulation has
+// always used, so readers built on these helpers select exactly the blocks
+// the writers produced.
+//
+
+#ifndef ADIOS2EXAMPLES_BLOCK_DECOMP_H
+#define ADIOS2EXAMPLES_BLOCK_DECOMP_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Start and count of block 'part' out of 'nparts' over [0, n) */
+void decomp_block_1d(size_t n, size_t nparts, size_t part, size_t *start,
+                     size_t *count);
+
+/* Index of the block owning global index i, inverse of decomp_block_1d.
+ An i outside [0, n) has no owner and gives nparts. */
+size_t decomp_owner_1d(size_t n, size_t nparts, size_t i);
+
+/* Per-dimension decomposition of an ndims box for the process at 'coords'
+ in a process grid of size 'nparts' */
+void decomp_block_nd(int ndims, const size_t *shape, const size_t *nparts,
+                     const size_t *coords, size_t *start, size_t *count);
+
+/* Grow a block by 'lo' layers below and 'hi' layers above in every
+ dimension. Non-periodic dimensions are clamped to the global shape, periodic
+ ones are not, so the caller has to wrap indices itself. */
+void decomp_ghost_nd(int ndims, const size_t *shape, const int *periodic,
+                     size_t lo, size_t hi, size_t *start, size_t *count);
+
+/* Split [0, n) across 'nparts' readers so that every part is made of whole
+ writer blocks. 'bounds' lists the nblocks+1 increasing block boundaries of
+ the writer layout along this dimension (bounds[0] == 0, bounds[nblocks] ==
+ n). Falls back to decomp_block_1d when there are fewer blocks than parts. */
+void decomp_aligned_1d(size_t nblocks, const size_t *bounds, size_t nparts,
+                       size_t part, size_t *start, size_t *count);
+
+/* Sort and deduplicate 'nstarts' block start offsets along one dimension of
+ length n into boundaries usable by decomp_aligned_1d. 'bounds' must hold
+ nstarts+2 entries; returns the number of blocks. */
+size_t decomp_bounds_1d(size_t n, size_t nstarts, const size_t *starts,
+                        size_t *bounds);
+
+/* Split [0, n) into 'nparts' contiguous parts of about equal total cost,
+ given the cost of every index in 'cost' (n entries). Every part gets at
+ least one index. 'bounds' receives the nparts+1 part boundaries. Falls back
+ to decomp_block_1d boundaries when n < nparts or the total cost is 0. */
+void decomp_weighted_1d(size_t n, const double *cost, size_t nparts,
+                        size_t *bounds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADIOS2EXAMPLES_BLOCK_DECOMP_H
@@ -0,0 +1,118 @@
+//
+// C++ interface to the block decomposition helpers in block-decomp.h
+//
+
+#ifndef ADIOS2EXAMPLES_BLOCK_DECOMP_HPP
+#define ADIOS2EXAMPLES_BLOCK_DECOMP_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "block-decomp.h"
+
+namespace decomp
+{
+
+// Start and count of a block in every dimension, in the same order as the
+// shape it was computed from
+struct Block
+{
+    std::vector<std::size_t> start;
+    std::vector<std::size_t> count;
+
+    std::size_t size() const
+    {
+        std::size_t n = 1;
+        for (const auto c : count)
+        {
+            n *= c;
+        }
+        return n;
+    }
+};
+
+inline void block_1d(std::size_t n, std::size_t nparts, std::size_t part,
+                     std::size_t &start, std::size_t &count)
+{
+    decomp_block_1d(n, nparts, part, &start, &count);
+}
+
+inline std::size_t owner_1d(std::size_t n, std::size_t nparts, std::size_t i)
+{
+    return decomp_owner_1d(n, nparts, i);
+}
+
+// Remainder-balanced block of the process at 'coords' in a process grid of
+// size 'nparts'
+inline Block block(const std::vector<std::size_t> &shape,
+                   const std::vector<std::size_t> &nparts,
+                   const std::vector<std::size_t> &coords)
+{
+    Block b;
+    b.start.resize(shape.size());
+    b.count.resize(shape.size());
+    decomp_block_nd(static_cast<int>(shape.size()), shape.data(),
+                    nparts.data(), coords.data(), b.start.data(),
+                    b.count.data());
+    return b;
+}
+
+// Grow a block by 'lo' layers below and 'hi' layers above, clamped to the
+// global shape
+inline Block ghost(Block b, const std::vector<std::size_t> &shape,
+                   std::size_t lo, std::size_t hi)
+{
+    decomp_ghost_nd(static_cast<int>(shape.size()), shape.data(), nullptr, lo,
+                    hi, b.start.data(), b.count.data());
+    return b;
+}
+
+// Writer block boundaries along one dimension from the block starts, e.g.
+// the Start[d] of every entry returned by Engine::BlocksInfo
+inline std::vector<std::size_t> bounds(std::size_t n,
+                                       const std::vector<std::size_t> &starts)
+{
+    std::vector<std::size_t> b(starts.size() + 2);
+    const std::size_t nblocks =
+        decomp_bounds_1d(n, starts.size(), starts.data(), b.data());
+    b.resize(nblocks + 1);
+    return b;
+}
+
+inline void aligned_1d(const std::vector<std::size_t> &bounds,
+                       std::size_t nparts, std::size_t part,
+                       std::size_t &start, std::size_t &count)
+{
+    decomp_aligned_1d(bounds.size() - 1, bounds.data(), nparts, part, &start,
+                      &count);
+}
+
+// Block of the process at 'coords' made of whole writer blocks, given the
+// writer boundaries in every dimension
+inline Block aligned(const std::vector<std::vector<std::size_t>> &bounds,
+                     const std::vector<std::size_t> &nparts,
+                     const std::vector<std::size_t> &coords)
+{
+    Block b;
+    b.start.resize(bounds.size());
+    b.count.resize(bounds.size());
+    for (std::size_t d = 0; d < bounds.size(); ++d)
+    {
+        aligned_1d(bounds[d], nparts[d], coords[d], b.start[d], b.count[d]);
+    }
+    return b;
+}
+
+// Boundaries of 'nparts' parts of [0, cost.size()) with about equal total
+// cost, every part at least one index long
+inline std::vector<std::size_t> weighted_1d(const std::vector<double> &cost,
+                                            std::size_t nparts)
+{
+    std::vector<std::size_t> b(nparts + 1);
+    decomp_weighted_1d(cost.size(), cost.data(), nparts, b.data());
+    return b;
+}
+
+} // end namespace decomp
+
+#endif // ADIOS2EXAMPLES_BLOCK_DECOMP_HPP
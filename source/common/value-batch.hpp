@@ -0,0 +1,92 @@
+//
+// Batching of small per-rank values across output steps
+//
+// Writing thousands of tiny LocalValue variables every step makes the
+// metadata, not the data, dominate the cost of a step. ValueBatch keeps the
+// values of one variable in memory and writes them every 'batch' steps as a
+// single 2D global array of shape {rows, nranks}, where row r holds the
+// value every rank added for application step steps[r]. The application step
+// of every row is written alongside as the 1D array "<name>/steps", so
+// readers can recover the per-step view.
+//
+
+#ifndef ADIOS2EXAMPLES_VALUE_BATCH_HPP
+#define ADIOS2EXAMPLES_VALUE_BATCH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <adios2.h>
+
+template <class T>
+class ValueBatch
+{
+public:
+    ValueBatch(adios2::IO &io, const std::string &name, std::size_t rank,
+               std::size_t nranks, std::size_t batch)
+    : rank(rank), nranks(nranks), batch(batch > 0 ? batch : 1)
+    {
+        var_values = io.DefineVariable<T>(name, {this->batch, nranks},
+                                          {0, rank}, {this->batch, 1});
+        if (rank == 0)
+        {
+            var_steps = io.DefineVariable<uint64_t>(
+                name + "/steps", {this->batch}, {0}, {this->batch});
+        }
+        io.DefineAttribute<std::string>(
+            name + "/layout",
+            "rows are application steps listed in " + name +
+                "/steps, columns are ranks");
+        values.reserve(this->batch);
+        steps.reserve(this->batch);
+    }
+
+    // Buffer this rank's value for application step 'step'
+    void add(uint64_t step, const T &value)
+    {
+        steps.push_back(step);
+        values.push_back(value);
+    }
+
+    bool full() const { return values.size() >= batch; }
+
+    bool empty() const { return values.empty(); }
+
+    // Put the buffered rows, must be called between BeginStep and EndStep
+    // by all ranks with the same number of buffered rows
+    void flush(adios2::Engine &engine)
+    {
+        if (values.empty())
+        {
+            return;
+        }
+        const std::size_t rows = values.size();
+        var_values.SetShape({rows, nranks});
+        var_values.SetSelection({{0, rank}, {rows, 1}});
+        // Sync so the buffers can be reused right away
+        engine.Put(var_values, values.data(), adios2::Mode::Sync);
+        if (var_steps)
+        {
+            var_steps.SetShape({rows});
+            var_steps.SetSelection({{0}, {rows}});
+            engine.Put(var_steps, steps.data(), adios2::Mode::Sync);
+        }
+        values.clear();
+        steps.clear();
+    }
+
+private:
+    std::size_t rank;
+    std::size_t nranks;
+    std::size_t batch;
+
+    adios2::Variable<T> var_values;
+    adios2::Variable<uint64_t> var_steps;
+
+    std::vector<T> values;
+    std::vector<uint64_t> steps;
+};
+
+#endif // ADIOS2EXAMPLES_VALUE_BATCH_HPP
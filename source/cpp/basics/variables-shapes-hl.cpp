@@ -9,6 +9,7 @@
  *      Author: William F Godoy godoywf@ornl.gov
  */
 
+#include <chrono>    // std::chrono::steady_clock
 #include <cstddef>   //std::size_t
 #include <iostream>  // std::cout
 #include <limits>    // std::numeric_limits
@@ -93,17 +94,21 @@ void writer(const std::size_t nx, const std::size_t nsteps, const int rank,
     out.close();
 }
 
-void reader(const int rank, const int size)
+std::string ArrayToString(const std::vector<float> &array)
 {
-    auto lf_ArrayToString = [](const std::vector<float> &array) -> std::string {
-        std::string contents = "{ ";
-        for (const float value : array)
-        {
-            contents += std::to_string(static_cast<int>(value)) + " ";
-        }
-        contents += "}";
-        return contents;
-    };
+    std::string contents = "{ ";
+    for (const float value : array)
+    {
+        contents += std::to_string(static_cast<int>(value)) + " ";
+    }
+    contents += "}";
+    return contents;
+}
+
+// returns the time spent reading in seconds
+double reader(const int rank, const int size)
+{
+    const auto start = std::chrono::steady_clock::now();
 
 // all ranks opening the bp file have access to the entire metadata
 #if ADIOS2_USE_MPI
@@ -147,7 +152,7 @@ void reader(const int rank, const int size)
         if (!globalArray.empty() && rank == 0)
         {
             std::cout << "Found globalArray "
-                      << lf_ArrayToString(globalArray) + " in currentStep "
+                      << ArrayToString(globalArray) + " in currentStep "
                       << currentStep << "\n";
         }
 
@@ -156,13 +161,98 @@ void reader(const int rank, const int size)
         if (!localArray.empty() && rank == 0)
         {
             std::cout << "Found localArray "
-                      << lf_ArrayToString(localArray) + " in currentStep "
+                      << ArrayToString(localArray) + " in currentStep "
                       << currentStep << "\n";
         }
         // indicate end of adios2 operations for this step
         in.end_step();
     }
     in.close();
+
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Reads the variables of reader() for all steps with a single read call
+// each instead of a getstep/read/end_step round trip per step. Only possible
+// when all steps are available up front (e.g. a BP file, not a stream).
+// Returns the time spent reading in seconds.
+double reader_multistep(const int rank)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+#if ADIOS2_USE_MPI
+    adios2::fstream in("variables-shapes_hl.bp", adios2::fstream::in,
+                       MPI_COMM_WORLD);
+#else
+    adios2::fstream in("variables-shapes_hl.bp", adios2::fstream::in);
+#endif
+
+    // every step is returned contiguously step by step, e.g. the global
+    // array of step s is globalArrays[s * shape + i]
+    const std::size_t nsteps = in.steps();
+    const std::vector<uint64_t> steps = in.read<uint64_t>("Step", 0, nsteps);
+    const std::vector<float> globalArrays =
+        in.read<float>("GlobalArray", 0, nsteps);
+    // default reads block 0 of every step
+    const std::vector<float> localArrays =
+        in.read<float>("LocalArray", 0, nsteps);
+
+    // steps count from the first one a variable was written in, these two
+    // are only written in the first step
+    const std::vector<std::string> globalValueString =
+        in.read<std::string>("GlobalValueString", 0, 1);
+    const std::vector<int32_t> ranks = in.read<int32_t>("Ranks", 0, 1);
+    in.close();
+
+    if (rank == 0)
+    {
+        const std::size_t globalSize = globalArrays.size() / nsteps;
+        const std::size_t localSize = localArrays.size() / nsteps;
+        for (std::size_t currentStep = 0; currentStep < nsteps; ++currentStep)
+        {
+            if (currentStep < steps.size())
+            {
+                std::cout << "Found Step " << steps[currentStep]
+                          << " in currentStep " << currentStep << "\n";
+            }
+            if (currentStep == 0 && !globalValueString.empty())
+            {
+                std::cout << "Found GlobalValueString "
+                          << globalValueString.front() << " in currentStep "
+                          << currentStep << "\n";
+            }
+            if (currentStep == 0 && !ranks.empty())
+            {
+                std::cout << "Found rank " << ranks.front()
+                          << " in currentStep " << currentStep << "\n";
+            }
+            if (globalSize > 0)
+            {
+                const auto first =
+                    globalArrays.begin() + currentStep * globalSize;
+                const std::vector<float> globalArray(first,
+                                                     first + globalSize);
+                std::cout << "Found globalArray "
+                          << ArrayToString(globalArray) + " in currentStep "
+                          << currentStep << "\n";
+            }
+            if (localSize > 0)
+            {
+                const auto first =
+                    localArrays.begin() + currentStep * localSize;
+                const std::vector<float> localArray(first, first + localSize);
+                std::cout << "Found localArray "
+                          << ArrayToString(localArray) + " in currentStep "
+                          << currentStep << "\n";
+            }
+        }
+    }
+
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
 }
 
 int main(int argc, char *argv[])
@@ -184,7 +274,15 @@ int main(int argc, char *argv[])
         constexpr std::size_t nsteps = 3;
 
         writer(nx, nsteps, rank, size);
-        reader(rank, size);
+        const double perStep = reader(rank, size) / nsteps;
+        const double batched = reader_multistep(rank) / nsteps;
+
+        if (rank == 0)
+        {
+            std::cout << "Read latency per step: step-by-step "
+                      << perStep * 1.0e6 << " us, batched " << batched * 1.0e6
+                      << " us\n";
+        }
     }
     catch (std::exception &e)
     {
@@ -10,6 +10,8 @@
  *      Author: William F Godoy godoywf@ornl.gov
  */
 
+#include <algorithm> // std::lower_bound
+#include <chrono>    // std::chrono::steady_clock
 #include <cstddef>   //std::size_t
 #include <iostream>  // std::cout
 #include <limits>    // std::numeric_limits
@@ -21,6 +23,8 @@
 #include <mpi.h>
 #endif
 
+#include "../../common/value-batch.hpp"
+
 void writer(adios2::ADIOS &adios, const std::size_t nx,
             const std::size_t nsteps, const int rank, const int size)
 {
@@ -87,6 +91,15 @@ void writer(adios2::ADIOS &adios, const std::size_t nx,
     adios2::Variable<float> varLocalArray = io.DefineVariable<float>(
         "LocalArray", {}, {}, count, adios2::ConstantDims);
 
+    /********** BATCHED LOCAL VALUES **********/
+    // Small per-rank values produced every step (e.g. telemetry) are cheaper
+    // to buffer and write every few steps as one global array
+    // {steps, ranks} than as a LocalValue variable per step
+    constexpr std::size_t batchSteps = 2;
+    ValueBatch<float> batchLocalSum(io, "LocalSum",
+                                    static_cast<std::size_t>(rank),
+                                    static_cast<std::size_t>(size), batchSteps);
+
     adios2::Engine writer = io.Open("variables-shapes.bp", adios2::Mode::Write);
 
     for (size_t step = 0; step < nsteps; ++step)
@@ -119,13 +132,25 @@ void writer(adios2::ADIOS &adios, const std::size_t nx,
         // for this example all ranks put a global and a local array
         writer.Put(varGlobalArray, array.data());
         writer.Put(varLocalArray, array.data());
+
+        // buffered every step, written only when the batch is full or at the
+        // last step
+        batchLocalSum.add(step, std::accumulate(array.begin(), array.end(),
+                                                0.0f));
+        if (batchLocalSum.full() || step == nsteps - 1)
+        {
+            batchLocalSum.flush(writer);
+        }
         writer.EndStep();
     }
     writer.Close();
 }
 
-void reader(adios2::ADIOS &adios, const int rank, const int size)
+// returns the time spent reading in seconds
+double reader(adios2::ADIOS &adios, const int rank, const int size)
 {
+    const auto start = std::chrono::steady_clock::now();
+
     adios2::IO io = adios.DeclareIO("variables-shapes_reader");
     // all ranks opening the bp file have access to the entire metadata
     adios2::Engine reader = io.Open("variables-shapes.bp", adios2::Mode::Read);
@@ -216,11 +241,36 @@ void reader(adios2::ADIOS &adios, const int rank, const int size)
             reader.Get(varLocalArray, localArray);
         }
 
+        // Batched local values: one row per application step, one column per
+        // rank, only present in the steps where the batch was flushed
+        adios2::Variable<float> varLocalSum =
+            io.InquireVariable<float>("LocalSum");
+        adios2::Variable<uint64_t> varLocalSumSteps =
+            io.InquireVariable<uint64_t>("LocalSum/steps");
+        std::vector<float> localSums;
+        std::vector<uint64_t> localSumSteps;
+        if (varLocalSum && varLocalSumSteps)
+        {
+            reader.Get(varLocalSum, localSums);
+            reader.Get(varLocalSumSteps, localSumSteps);
+        }
+
         // since all Get calls are "deferred" all the data would be populated at
         // EndStep
         reader.EndStep();
 
         // data is available
+        if (rank == 0 && !localSumSteps.empty())
+        {
+            const std::size_t nranks = localSums.size() / localSumSteps.size();
+            for (std::size_t r = 0; r < localSumSteps.size(); ++r)
+            {
+                std::cout << "Found LocalSum of " << nranks
+                          << " ranks for step " << localSumSteps[r]
+                          << ", rank 0 value " << localSums[r * nranks]
+                          << " in step " << currentStep << "\n";
+            }
+        }
 
         if (rank == 0)
         {
@@ -229,6 +279,196 @@ void reader(adios2::ADIOS &adios, const int rank, const int size)
     }
 
     reader.Close();
+
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Steps of a file opened for random access that hold var. A step selection
+// only counts these, its relative step r is the file step steps[r].
+template <class T>
+std::vector<std::size_t> steps_with(const adios2::Engine &reader,
+                                    const adios2::Variable<T> &var,
+                                    const std::size_t nsteps)
+{
+    std::vector<std::size_t> steps;
+    for (std::size_t step = 0; var && step < nsteps; ++step)
+    {
+        if (!reader.BlocksInfo(var, step).empty())
+        {
+            steps.push_back(step);
+        }
+    }
+    return steps;
+}
+
+// Relative step of a file step in steps, steps.size() if it is not there
+std::size_t relative_step(const std::vector<std::size_t> &steps,
+                          const std::size_t step)
+{
+    const auto it = std::lower_bound(steps.begin(), steps.end(), step);
+    return (it != steps.end() && *it == step)
+               ? static_cast<std::size_t>(it - steps.begin())
+               : steps.size();
+}
+
+// Reads the variables of reader() for all steps with one round trip instead
+// of one BeginStep/Get/EndStep round trip per step. Only possible when all
+// steps are available up front (e.g. a BP file, not a stream).
+// Returns the time spent reading in seconds.
+double reader_multistep(adios2::ADIOS &adios, const int rank)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    adios2::IO io = adios.DeclareIO("variables-shapes_reader_multistep");
+    // random access mode gives access to all steps at once
+    adios2::Engine reader =
+        io.Open("variables-shapes.bp", adios2::Mode::ReadRandomAccess);
+    const std::size_t nsteps = reader.Steps();
+
+    adios2::Variable<uint64_t> varStep = io.InquireVariable<uint64_t>("Step");
+    adios2::Variable<std::string> varGlobalValueString =
+        io.InquireVariable<std::string>("GlobalValueString");
+    adios2::Variable<int32_t> varRanks = io.InquireVariable<int32_t>("Ranks");
+    adios2::Variable<float> varGlobalArray =
+        io.InquireVariable<float>("GlobalArray");
+    adios2::Variable<float> varLocalArray =
+        io.InquireVariable<float>("LocalArray");
+    adios2::Variable<float> varLocalSum = io.InquireVariable<float>("LocalSum");
+    adios2::Variable<uint64_t> varLocalSumSteps =
+        io.InquireVariable<uint64_t>("LocalSum/steps");
+
+    const std::vector<std::size_t> stepsStep =
+        steps_with(reader, varStep, nsteps);
+    const std::vector<std::size_t> stepsGlobalValueString =
+        steps_with(reader, varGlobalValueString, nsteps);
+    const std::vector<std::size_t> stepsRanks =
+        steps_with(reader, varRanks, nsteps);
+    const std::vector<std::size_t> stepsGlobalArray =
+        steps_with(reader, varGlobalArray, nsteps);
+    const std::vector<std::size_t> stepsLocalArray =
+        steps_with(reader, varLocalArray, nsteps);
+    // LocalSum/steps is written along with LocalSum
+    const std::vector<std::size_t> stepsLocalSum =
+        steps_with(reader, varLocalSum, nsteps);
+
+    // Step selection: {first step, number of steps}. All steps of the
+    // selection land contiguously in one buffer, step by step:
+    // globalArrays[step * shape + i]
+    std::vector<uint64_t> steps;
+    if (varStep)
+    {
+        varStep.SetStepSelection({0, stepsStep.size()});
+        reader.Get(varStep, steps);
+    }
+    std::vector<int32_t> ranks;
+    if (varRanks)
+    {
+        varRanks.SetStepSelection({0, stepsRanks.size()});
+        reader.Get(varRanks, ranks);
+    }
+    std::vector<float> globalArrays;
+    if (varGlobalArray)
+    {
+        varGlobalArray.SetStepSelection({0, stepsGlobalArray.size()});
+        reader.Get(varGlobalArray, globalArrays);
+    }
+
+    // Strings, blocks of local arrays and arrays whose shape changes between
+    // steps are selected step by step, still read in the one round trip
+    std::vector<std::string> globalValueStrings(stepsGlobalValueString.size());
+    for (std::size_t r = 0; r < globalValueStrings.size(); ++r)
+    {
+        varGlobalValueString.SetStepSelection({r, 1});
+        reader.Get(varGlobalValueString, globalValueStrings[r]);
+    }
+    std::vector<std::vector<float>> localArrays(stepsLocalArray.size());
+    for (std::size_t r = 0; r < localArrays.size(); ++r)
+    {
+        varLocalArray.SetBlockSelection(0);
+        varLocalArray.SetStepSelection({r, 1});
+        reader.Get(varLocalArray, localArrays[r]);
+    }
+    std::vector<std::vector<float>> localSums;
+    std::vector<std::vector<uint64_t>> localSumSteps;
+    if (varLocalSum && varLocalSumSteps)
+    {
+        localSums.resize(stepsLocalSum.size());
+        localSumSteps.resize(stepsLocalSum.size());
+    }
+    for (std::size_t r = 0; r < localSums.size(); ++r)
+    {
+        // one {rows, 1} block per rank
+        const auto blocks = reader.BlocksInfo(varLocalSum, stepsLocalSum[r]);
+        const std::size_t rows = blocks.front().Count[0];
+        varLocalSum.SetSelection({{0, 0}, {rows, blocks.size()}});
+        varLocalSum.SetStepSelection({r, 1});
+        reader.Get(varLocalSum, localSums[r]);
+        varLocalSumSteps.SetSelection({{0}, {rows}});
+        varLocalSumSteps.SetStepSelection({r, 1});
+        reader.Get(varLocalSumSteps, localSumSteps[r]);
+    }
+
+    // one round trip for all steps
+    reader.PerformGets();
+    reader.Close();
+
+    if (rank == 0)
+    {
+        for (std::size_t currentStep = 0; currentStep < nsteps; ++currentStep)
+        {
+            if (relative_step(stepsStep, currentStep) < stepsStep.size())
+            {
+                std::cout << "Found Global Value " << varStep << " in step "
+                          << currentStep << "\n";
+            }
+            if (relative_step(stepsGlobalValueString, currentStep) <
+                stepsGlobalValueString.size())
+            {
+                std::cout << "Found Global Value " << varGlobalValueString
+                          << " in step " << currentStep << "\n";
+            }
+            if (relative_step(stepsRanks, currentStep) < stepsRanks.size())
+            {
+                std::cout << "Found Global Array " << varRanks << " in step "
+                          << currentStep << "\n";
+            }
+            if (relative_step(stepsGlobalArray, currentStep) <
+                stepsGlobalArray.size())
+            {
+                std::cout << "Found GlobalArray " << varGlobalArray
+                          << " in step " << currentStep << "\n";
+            }
+            if (relative_step(stepsLocalArray, currentStep) <
+                stepsLocalArray.size())
+            {
+                std::cout << "Found LocalArray " << varLocalArray << " in step "
+                          << currentStep << "\n";
+            }
+
+            const std::size_t r = relative_step(stepsLocalSum, currentStep);
+            if (r < localSums.size() && !localSumSteps[r].empty())
+            {
+                const std::size_t nranks =
+                    localSums[r].size() / localSumSteps[r].size();
+                for (std::size_t row = 0; row < localSumSteps[r].size(); ++row)
+                {
+                    std::cout << "Found LocalSum of " << nranks
+                              << " ranks for step " << localSumSteps[r][row]
+                              << ", rank 0 value "
+                              << localSums[r][row * nranks] << " in step "
+                              << currentStep << "\n";
+                }
+            }
+
+            std::cout << "\n";
+        }
+    }
+
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
 }
 
 int main(int argc, char *argv[])
@@ -257,7 +497,15 @@ int main(int argc, char *argv[])
         constexpr std::size_t nsteps = 3;
 
         writer(adios, nx, nsteps, rank, size);
-        reader(adios, rank, size);
+        const double perStep = reader(adios, rank, size) / nsteps;
+        const double batched = reader_multistep(adios, rank) / nsteps;
+
+        if (rank == 0)
+        {
+            std::cout << "Read latency per step: step-by-step "
+                      << perStep * 1.0e6 << " us, batched " << batched * 1.0e6
+                      << " us\n";
+        }
     }
     catch (const std::exception &e)
     {
@@ -21,6 +21,7 @@
 #include <vtkSmartPointer.h>
 #include <vtkXMLPolyDataWriter.h>
 
+#include "../../../common/block-decomp.hpp"
 #include "../../gray-scott/common/timer.hpp"
 
 vtkSmartPointer<vtkPolyData>
@@ -272,31 +273,28 @@ int main(int argc, char *argv[])
 
         adios2::Dims shape = varU.Shape();
 
-        size_t size_x = (shape[0] + npx - 1) / npx;
-        size_t size_y = (shape[1] + npy - 1) / npy;
-        size_t size_z = (shape[2] + npz - 1) / npz;
-
-        size_t offset_x = size_x * px;
-        size_t offset_y = size_y * py;
-        size_t offset_z = size_z * pz;
-
-        if (px == npx - 1)
+        // Line the read selection up with the blocks written by the
+        // simulation, so every rank reads whole blocks
+        std::vector<std::vector<size_t>> starts(shape.size());
+        for (const auto &info : reader.BlocksInfo(varU, reader.CurrentStep()))
         {
-            size_x -= size_x * npx - shape[0];
+            for (size_t d = 0; d < shape.size(); ++d)
+            {
+                starts[d].push_back(info.Start[d]);
+            }
         }
-        if (py == npy - 1)
+        std::vector<std::vector<size_t>> bounds(shape.size());
+        for (size_t d = 0; d < shape.size(); ++d)
         {
-            size_y -= size_y * npy - shape[1];
-        }
-        if (pz == npz - 1)
-        {
-            size_z -= size_z * npz - shape[2];
+            bounds[d] = decomp::bounds(shape[d], starts[d]);
         }
 
-        varU.SetSelection({{offset_x, offset_y, offset_z},
-                           {size_x + (px != npx - 1 ? 1 : 0),
-                            size_y + (py != npy - 1 ? 1 : 0),
-                            size_z + (pz != npz - 1 ? 1 : 0)}});
+        // Marching cubes needs one layer of overlap with the next block
+        const decomp::Block block = decomp::ghost(
+            decomp::aligned(bounds, {npx, npy, npz}, {px, py, pz}), shape, 0,
+            1);
+
+        varU.SetSelection({block.start, block.count});
 
         reader.Get<double>(varU, u);
         reader.Get<int>(varStep, step);
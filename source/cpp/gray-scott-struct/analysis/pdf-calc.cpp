@@ -1,6 +1,6 @@
 /*
  * Analysis code for the Gray-Scott application.
- * Reads variable U and V, and computes the PDF for each 2D slices of U and V.
+ * Reads U and V, and computes the PDF for each 2D slices of U and V.
  * Writes the computed PDFs using ADIOS.
  *
  * Norbert Podhorszki, pnorbert@ornl.gov
@@ -18,6 +18,9 @@
 
 #include "adios2.h"
 
+#include "../../../common/block-decomp.hpp"
+#include "../common/fields.hpp"
+
 bool epsilon(double d) { return (d < 1.0e-20); }
 bool epsilon(float d) { return (d < 1.0e-20); }
 
@@ -164,8 +167,6 @@ int main(int argc, char *argv[])
 
     std::vector<std::size_t> shape;
 
-    std::vector<double> u;
-    std::vector<double> v;
     int simStep = -5;
 
     std::vector<double> pdf_u;
@@ -174,7 +175,6 @@ int main(int argc, char *argv[])
     std::vector<double> bins_v;
 
     // adios2 variable declarations
-    adios2::Variable<double> var_u_in, var_v_in;
     adios2::Variable<int> var_step_in;
     adios2::Variable<double> var_u_pdf, var_v_pdf;
     adios2::Variable<double> var_u_bins, var_v_bins;
@@ -204,6 +204,10 @@ int main(int argc, char *argv[])
         adios2::Engine writer =
             writer_io.Open(out_filename, adios2::Mode::Write, comm);
 
+        // U and V, interleaved in UV when the simulation runs with
+        // adios_struct
+        FieldsReader fields(ad, reader_io);
+
         bool shouldIWrite = (!rank || reader_io.EngineType() == "HDF5");
 
         // read data per timestep
@@ -232,14 +236,14 @@ int main(int argc, char *argv[])
             // timesteps
 
             // Inquire variable
-            var_u_in = reader_io.InquireVariable<double>("U");
-            var_v_in = reader_io.InquireVariable<double>("V");
+            if (!fields.Inquire())
+            {
+                throw std::runtime_error(
+                    "ERROR: the input has neither UV nor U and V\n");
+            }
             var_step_in = reader_io.InquireVariable<int>("step");
 
-            std::pair<double, double> minmax_u = var_u_in.MinMax();
-            std::pair<double, double> minmax_v = var_v_in.MinMax();
-
-            shape = var_u_in.Shape();
+            shape = fields.Shape();
 
             // Calculate global and local sizes of U and V
             u_global_size = shape[0] * shape[1] * shape[2];
@@ -247,13 +251,12 @@ int main(int argc, char *argv[])
             v_global_size = shape[0] * shape[1] * shape[2];
             v_local_size = v_global_size / comm_size;
 
-            size_t count1 = shape[0] / comm_size;
-            size_t start1 = count1 * rank;
-            if (rank == comm_size - 1)
-            {
-                // last process need to read all the rest of slices
-                count1 = shape[0] - count1 * (comm_size - 1);
-            }
+            // Split the slices along the slowest dimension so that every
+            // process reads whole blocks written by the simulation. The
+            // blocks of UV are not known, it is split evenly.
+            size_t start1, count1;
+            decomp::aligned_1d(decomp::bounds(shape[0], fields.Starts(reader)),
+                               comm_size, rank, start1, count1);
 
             /*std::cout << "  rank " << rank << " slice start={" <<  start1
               << ",0,0} count={" << count1  << "," << shape[1] << "," <<
@@ -261,9 +264,7 @@ int main(int argc, char *argv[])
               << "}" << std::endl;*/
 
             // Set selection
-            var_u_in.SetSelection(adios2::Box<adios2::Dims>(
-                {start1, 0, 0}, {count1, shape[1], shape[2]}));
-            var_v_in.SetSelection(adios2::Box<adios2::Dims>(
+            fields.SetSelection(adios2::Box<adios2::Dims>(
                 {start1, 0, 0}, {count1, shape[1], shape[2]}));
 
             // Declare variables to output
@@ -296,8 +297,7 @@ int main(int argc, char *argv[])
             }
 
             // Read adios2 data
-            reader.Get<double>(var_u_in, u);
-            reader.Get<double>(var_v_in, v);
+            fields.Get(reader);
             if (shouldIWrite)
             {
                 reader.Get<int>(var_step_in, &simStep);
@@ -313,8 +313,13 @@ int main(int argc, char *argv[])
                           << " sim compute step " << simStep << std::endl;
             }
 
-            // HDF5 engine does not provide min/max. Let's calculate it
-            //        if (reader_io.EngineType() == "HDF5")
+            // Deinterleaved here if the input is UV
+            const std::vector<double> &u = fields.u();
+            const std::vector<double> &v = fields.v();
+
+            // HDF5 engine does not provide min/max, nor does a struct
+            // variable. Let's calculate it
+            std::pair<double, double> minmax_u, minmax_v;
             {
                 auto mmu = std::minmax_element(u.begin(), u.end());
                 minmax_u = std::make_pair(*mmu.first, *mmu.second);
@@ -0,0 +1,147 @@
+#ifndef __FIELDS_HPP__
+#define __FIELDS_HPP__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <adios2.h>
+
+// Reads U and V from the output of the simulation. With adios_struct it
+// writes the variable UV of struct type MemLayout, u and v interleaved as
+// they are in memory, otherwise the separate variables U and V.
+//
+// UV is read as it is and only deinterleaved by the first call of u() or
+// v() after the data arrived, so a reader of one field pays for one pass
+// over it and a reader of both for two.
+class FieldsReader
+{
+public:
+    struct MemLayout
+    {
+        double u, v;
+    };
+
+    FieldsReader(adios2::ADIOS &ad, adios2::IO io)
+    : io(io), def(ad.DefineStruct("MemLayout", sizeof(MemLayout)))
+    {
+        def.AddField("u", offsetof(MemLayout, u), adios2::DataType::Double);
+        def.AddField("v", offsetof(MemLayout, v), adios2::DataType::Double);
+    }
+
+    // Look the fields up in the current step, false if it has none
+    bool Inquire()
+    {
+        var_uv = io.InquireStructVariable("UV", def);
+        if (var_uv)
+        {
+            return true;
+        }
+        var_u = io.InquireVariable<double>("U");
+        var_v = io.InquireVariable<double>("V");
+        return var_u && var_v;
+    }
+
+    bool Interleaved() const { return static_cast<bool>(var_uv); }
+
+    adios2::Dims Shape() const
+    {
+        return var_uv ? var_uv.Shape() : var_u.Shape();
+    }
+
+    // Start of every writer block in the slowest dimension. Blocks of a
+    // struct variable are not listed by the engine, then this is empty.
+    std::vector<size_t> Starts(const adios2::Engine &engine) const
+    {
+        std::vector<size_t> starts;
+        if (!var_uv)
+        {
+            for (const auto &info :
+                 engine.BlocksInfo(var_u, engine.CurrentStep()))
+            {
+                starts.push_back(info.Start[0]);
+            }
+        }
+        return starts;
+    }
+
+    void SetSelection(const adios2::Box<adios2::Dims> &box)
+    {
+        size_t n = 1;
+        for (const size_t c : box.second)
+        {
+            n *= c;
+        }
+        if (var_uv)
+        {
+            var_uv.SetSelection(box);
+            uv.resize(n);
+        }
+        else
+        {
+            var_u.SetSelection(box);
+            var_v.SetSelection(box);
+        }
+        size = n;
+    }
+
+    // Deferred like Engine::Get, u() and v() are valid after EndStep or
+    // PerformGets
+    void Get(adios2::Engine &engine)
+    {
+        if (var_uv)
+        {
+            engine.Get(var_uv, uv.data());
+            have_u = have_v = false;
+        }
+        else
+        {
+            u_data.resize(size);
+            v_data.resize(size);
+            engine.Get<double>(var_u, u_data.data());
+            engine.Get<double>(var_v, v_data.data());
+            have_u = have_v = true;
+        }
+    }
+
+    const std::vector<double> &u()
+    {
+        if (!have_u)
+        {
+            u_data.resize(uv.size());
+            for (size_t i = 0; i < uv.size(); ++i)
+            {
+                u_data[i] = uv[i].u;
+            }
+            have_u = true;
+        }
+        return u_data;
+    }
+
+    const std::vector<double> &v()
+    {
+        if (!have_v)
+        {
+            v_data.resize(uv.size());
+            for (size_t i = 0; i < uv.size(); ++i)
+            {
+                v_data[i] = uv[i].v;
+            }
+            have_v = true;
+        }
+        return v_data;
+    }
+
+private:
+    adios2::IO io;
+    adios2::StructDefinition def;
+    adios2::VariableStruct var_uv;
+    adios2::Variable<double> var_u, var_v;
+    size_t size = 0;
+    std::vector<MemLayout> uv;
+    std::vector<double> u_data, v_data;
+    bool have_u = false;
+    bool have_v = false;
+};
+
+#endif
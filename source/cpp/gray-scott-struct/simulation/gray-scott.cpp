@@ -4,10 +4,12 @@
 
 #include "gray-scott.h"
 
+#include "../../../common/block-decomp.hpp"
+
+#include <algorithm>
 #include <mpi.h>
 #include <random>
-#include <stddef.h>  // offsetof
-#include <stdexcept> // runtime_error
+#include <stdexcept> // invalid_argument, runtime_error
 #include <vector>
 
 GrayScott::GrayScott(const Settings &settings, MPI_Comm comm)
@@ -31,9 +33,9 @@ void GrayScott::iterate()
     d.swap(d2);
 }
 
-void GrayScott::restart(std::vector<MemLayout> &d_in)
+void GrayScott::restart(std::vector<double> &d_in)
 {
-    auto expected_len = (size_x + 2) * (size_y + 2) * (size_z + 2);
+    auto expected_len = d.size();
     if (d_in.size() == expected_len)
     {
         d = d_in;
@@ -47,41 +49,62 @@ void GrayScott::restart(std::vector<MemLayout> &d_in)
     }
 }
 
-const std::vector<GrayScott::MemLayout> &GrayScott::d_ghost() const
-{
-    return d;
-}
+const std::vector<double> &GrayScott::d_ghost() const { return d; }
 
 std::vector<GrayScott::MemLayout> GrayScott::d_noghost() const
 {
-    return data_noghost(d);
-}
-
-void GrayScott::d_noghost(GrayScott::MemLayout *u_no_ghost) const
-{
-    data_noghost(d, u_no_ghost);
+    std::vector<GrayScott::MemLayout> buf(size_x * size_y * size_z);
+    d_noghost(buf.data());
+    return buf;
 }
 
-std::vector<GrayScott::MemLayout>
-GrayScott::data_noghost(const std::vector<GrayScott::MemLayout> &data) const
+void GrayScott::d_noghost(GrayScott::MemLayout *d_no_ghost) const
 {
-    std::vector<GrayScott::MemLayout> buf(size_x * size_y * size_z);
-    data_no_ghost_common(data, buf.data());
-    return buf;
+    for (int z = 1; z < size_z + 1; z++)
+    {
+        for (int y = 1; y < size_y + 1; y++)
+        {
+            for (int x = 1; x < size_x + 1; x++)
+            {
+                const size_t i = l2i(x, y, z);
+                MemLayout &c = d_no_ghost[(x - 1) + (y - 1) * size_x +
+                                          (z - 1) * size_x * size_y];
+                c.u = d[iu(i)];
+                c.v = d[iv(i)];
+            }
+        }
+    }
 }
 
-void GrayScott::data_noghost(const std::vector<GrayScott::MemLayout> &data,
-                             GrayScott::MemLayout *data_no_ghost) const
+void GrayScott::uv_noghost(double *u_no_ghost, double *v_no_ghost) const
 {
-    data_no_ghost_common(data, data_no_ghost);
+    for (int z = 1; z < size_z + 1; z++)
+    {
+        for (int y = 1; y < size_y + 1; y++)
+        {
+            for (int x = 1; x < size_x + 1; x++)
+            {
+                const size_t i = (x - 1) + (y - 1) * size_x +
+                                 (z - 1) * size_x * size_y;
+                const size_t j = l2i(x, y, z);
+                u_no_ghost[i] = d[iu(j)];
+                v_no_ghost[i] = d[iv(j)];
+            }
+        }
+    }
 }
 
 void GrayScott::init_field()
 {
-    const int V = (size_x + 2) * (size_y + 2) * (size_z + 2);
-    MemLayout initvalue = {1.0, 0.0};
-    d.resize(V, initvalue);
-    d2.resize(V, initvalue);
+    const size_t V = padded_x * (size_y + 2) * (size_z + 2);
+    d.resize(2 * V);
+    for (size_t i = 0; i < V; i++)
+    {
+        d[iu(i)] = 1.0;
+        d[iv(i)] = 0.0;
+    }
+    d2 = d;
+    noise_row.assign(padded_x, 0.0);
 
     const int dd = 6;
     for (int z = settings.L / 2 - dd; z < settings.L / 2 + dd; z++)
@@ -93,8 +116,8 @@ void GrayScott::init_field()
                 if (!is_inside(x, y, z))
                     continue;
                 int i = g2i(x, y, z);
-                d[i].u = 0.25;
-                d[i].v = 0.33;
+                d[iu(i)] = 0.25;
+                d[iv(i)] = 0.33;
             }
         }
     }
@@ -110,54 +133,123 @@ double GrayScott::calcV(double tu, double tv) const
     return tu * tv * tv - (settings.F + settings.k) * tv;
 }
 
-GrayScott::MemLayout GrayScott::laplacian(int x, int y, int z,
-                                          const std::vector<MemLayout> &s) const
+void GrayScott::calc(const std::vector<double> &d, std::vector<double> &d2)
 {
-    MemLayout dd = {0.0,0.0};
+    switch (width)
     {
-        double &ts = dd.u;
-        ts += s[l2i(x - 1, y, z)].u;
-        ts += s[l2i(x + 1, y, z)].u;
-        ts += s[l2i(x, y - 1, z)].u;
-        ts += s[l2i(x, y + 1, z)].u;
-        ts += s[l2i(x, y, z - 1)].u;
-        ts += s[l2i(x, y, z + 1)].u;
-        ts += -6.0 * s[l2i(x, y, z)].u;
-        ts = ts / 6.0;
+    case 1:
+        calc_layout<1>(d, d2);
+        break;
+    case 2:
+        calc_layout<2>(d, d2);
+        break;
+    case 4:
+        calc_layout<4>(d, d2);
+        break;
+    case 8:
+        calc_layout<8>(d, d2);
+        break;
+    default:
+        calc_layout<16>(d, d2);
+        break;
     }
-
-    {
-        double &ts = dd.v;
-        ts += s[l2i(x - 1, y, z)].v;
-        ts += s[l2i(x + 1, y, z)].v;
-        ts += s[l2i(x, y - 1, z)].v;
-        ts += s[l2i(x, y + 1, z)].v;
-        ts += s[l2i(x, y, z - 1)].v;
-        ts += s[l2i(x, y, z + 1)].v;
-        ts += -6.0 * s[l2i(x, y, z)].v;
-        ts = ts / 6.0;
-    }
-    return dd;
 }
 
-void GrayScott::calc(const std::vector<MemLayout> &d,
-                     std::vector<MemLayout> &d2)
+template <int W>
+void GrayScott::calc_layout(const std::vector<double> &d,
+                            std::vector<double> &d2)
 {
+    // Rows start on a block, so the neighbours in y and z of a block are
+    // whole blocks, dy and dz doubles away
+    const int dy = 2 * padded_x;
+    const int dz = 2 * padded_x * (size_y + 2);
+    const int last = size_x / W;
+
     for (int z = 1; z < size_z + 1; z++)
     {
         for (int y = 1; y < size_y + 1; y++)
         {
-            for (int x = 1; x < size_x + 1; x++)
+            // Drawn in the order of the cells, so the row below is free of
+            // calls. Without noise the row stays zero.
+            if (settings.noise != 0.0)
+            {
+                for (int x = 1; x < size_x + 1; x++)
+                {
+                    noise_row[x] = settings.noise * uniform_dist(mt_gen);
+                }
+            }
+
+            const double *row = d.data() + 2 * l2i(0, y, z);
+            double *out = d2.data() + 2 * l2i(0, y, z);
+            for (int b = 0; b <= last; b++)
             {
-                const int i = l2i(x, y, z);
-                MemLayout dd = laplacian(x, y, z, d);
-                dd.u = settings.Du * dd.u;
-                dd.v = settings.Dv * dd.v;
-                dd.u += calcU(d[i].u, d[i].v);
-                dd.v += calcV(d[i].u, d[i].v);
-                dd.u += settings.noise * uniform_dist(mt_gen);
-                d2[i].u = d[i].u + dd.u * settings.dt;
-                d2[i].v = d[i].v + dd.v * settings.dt;
+                const double *u = row + 2 * W * b;
+                const double *v = u + W;
+
+                // x - 1 and x + 1, the ends from the blocks around
+                double uw[W], ue[W], vw[W], ve[W];
+                uw[0] = u[-W - 1];
+                vw[0] = v[-W - 1];
+                for (int l = 1; l < W; l++)
+                {
+                    uw[l] = u[l - 1];
+                    vw[l] = v[l - 1];
+                }
+                for (int l = 0; l < W - 1; l++)
+                {
+                    ue[l] = u[l + 1];
+                    ve[l] = v[l + 1];
+                }
+                ue[W - 1] = u[2 * W];
+                ve[W - 1] = v[2 * W];
+
+                double nu[W], nv[W];
+                for (int l = 0; l < W; l++)
+                {
+                    const double tu = u[l];
+                    const double tv = v[l];
+
+                    // Laplacian
+                    double du = 0.0;
+                    du += uw[l];
+                    du += ue[l];
+                    du += u[l - dy];
+                    du += u[l + dy];
+                    du += u[l - dz];
+                    du += u[l + dz];
+                    du += -6.0 * tu;
+                    du = du / 6.0;
+
+                    double dv = 0.0;
+                    dv += vw[l];
+                    dv += ve[l];
+                    dv += v[l - dy];
+                    dv += v[l + dy];
+                    dv += v[l - dz];
+                    dv += v[l + dz];
+                    dv += -6.0 * tv;
+                    dv = dv / 6.0;
+
+                    du = settings.Du * du;
+                    dv = settings.Dv * dv;
+                    du += calcU(tu, tv);
+                    dv += calcV(tu, tv);
+                    du += noise_row[b * W + l];
+                    nu[l] = tu + du * settings.dt;
+                    nv[l] = tv + dv * settings.dt;
+                }
+
+                // Only the interior is stored, the blocks at the ends of the
+                // row also hold ghosts and padding
+                const int lo = b == 0 ? 1 : 0;
+                const int hi = std::min(W, static_cast<int>(size_x) + 1 - b * W);
+                double *tu = out + 2 * W * b;
+                double *tv = tu + W;
+                for (int l = lo; l < hi; l++)
+                {
+                    tu[l] = nu[l];
+                    tv[l] = nv[l];
+                }
             }
         }
     }
@@ -183,118 +275,126 @@ void GrayScott::init_mpi()
     py = coords[1];
     pz = coords[2];
 
-    size_x = settings.L / npx;
-    size_y = settings.L / npy;
-    size_z = settings.L / npz;
-
-    if (px < settings.L % npx)
-    {
-        size_x++;
-    }
-    if (py < settings.L % npy)
+    const decomp::Block block =
+        decomp::block({settings.L, settings.L, settings.L}, {npx, npy, npz},
+                      {px, py, pz});
+    size_x = block.count[0];
+    size_y = block.count[1];
+    size_z = block.count[2];
+    offset_x = block.start[0];
+    offset_y = block.start[1];
+    offset_z = block.start[2];
+
+    width = settings.aosoa_width;
+    if (width != 1 && width != 2 && width != 4 && width != 8 && width != 16)
     {
-        size_y++;
-    }
-    if (pz < settings.L % npz)
-    {
-        size_z++;
+        throw std::invalid_argument(
+            "ERROR: aosoa_width must be 1, 2, 4, 8 or 16, got " +
+            std::to_string(settings.aosoa_width) + "\n");
     }
-
-    offset_x = (settings.L / npx * px) + std::min(settings.L % npx, px);
-    offset_y = (settings.L / npy * py) + std::min(settings.L % npy, py);
-    offset_z = (settings.L / npz * pz) + std::min(settings.L % npz, pz);
+    padded_x = (size_x + 2 + width - 1) / width * width;
 
     MPI_Cart_shift(cart_comm, 0, 1, &west, &east);
     MPI_Cart_shift(cart_comm, 1, 1, &down, &up);
     MPI_Cart_shift(cart_comm, 2, 1, &south, &north);
 
-    // MPI type for Memory Layout
-    int count = 2;
-    int array_of_blocklengths[] = {1, 1};
-    MPI_Aint array_of_displacements[] = {offsetof(MemLayout, u),
-                                         offsetof(MemLayout, v)};
-    MPI_Datatype array_of_types[] = {MPI_DOUBLE, MPI_DOUBLE};
-    MPI_Type_create_struct(count, array_of_blocklengths, array_of_displacements,
-                           array_of_types, &memlayout_type);
-    MPI_Type_commit(&memlayout_type);
-
-    // XY faces: size_x * (size_y + 2)
-    MPI_Type_vector(size_y + 2, size_x, size_x + 2, memlayout_type,
-                    &xy_face_type);
-    MPI_Type_commit(&xy_face_type);
-
-    // XZ faces: size_x * size_z
-    MPI_Type_vector(size_z, size_x, (size_x + 2) * (size_y + 2), memlayout_type,
-                    &xz_face_type);
-    MPI_Type_commit(&xz_face_type);
-
-    // YZ faces: (size_y + 2) * (size_z + 2)
-    MPI_Type_vector((size_y + 2) * (size_z + 2), 1, size_x + 2, memlayout_type,
-                    &yz_face_type);
-    MPI_Type_commit(&yz_face_type);
+    const int X = size_x, Y = size_y, Z = size_z;
+    const int planes_x[4] = {0, 1, X, X + 1};
+    const int planes_y[4] = {0, 1, Y, Y + 1};
+    const int planes_z[4] = {0, 1, Z, Z + 1};
+    for (int p = 0; p < 4; p++)
+    {
+        // XY faces: size_x * (size_y + 2)
+        xy_face_type[p] =
+            face_type(1, X + 1, 0, Y + 2, planes_z[p], planes_z[p] + 1);
+        // XZ faces: size_x * size_z
+        xz_face_type[p] =
+            face_type(1, X + 1, planes_y[p], planes_y[p] + 1, 1, Z + 1);
+        // YZ faces: (size_y + 2) * (size_z + 2)
+        yz_face_type[p] =
+            face_type(planes_x[p], planes_x[p] + 1, 0, Y + 2, 0, Z + 2);
+    }
+}
+
+MPI_Datatype GrayScott::face_type(int x0, int x1, int y0, int y1, int z0,
+                                  int z1) const
+{
+    // u and v of every cell in turn, runs of adjacent doubles merged. In the
+    // AoS layout a row of a face is one run.
+    std::vector<int> lengths, displacements;
+    auto add = [&](int pos) {
+        if (!lengths.empty() && displacements.back() + lengths.back() == pos)
+        {
+            lengths.back()++;
+        }
+        else
+        {
+            displacements.push_back(pos);
+            lengths.push_back(1);
+        }
+    };
+    for (int z = z0; z < z1; z++)
+    {
+        for (int y = y0; y < y1; y++)
+        {
+            for (int x = x0; x < x1; x++)
+            {
+                const size_t i = l2i(x, y, z);
+                add(static_cast<int>(iu(i)));
+                add(static_cast<int>(iv(i)));
+            }
+        }
+    }
+
+    MPI_Datatype type;
+    MPI_Type_indexed(static_cast<int>(lengths.size()), lengths.data(),
+                     displacements.data(), MPI_DOUBLE, &type);
+    MPI_Type_commit(&type);
+    return type;
 }
 
-void GrayScott::exchange_xy(std::vector<MemLayout> &local_data) const
+void GrayScott::exchange_xy(std::vector<double> &local_data) const
 {
     MPI_Status st;
+    double *data = local_data.data();
 
     // Send XY face z=size_z to north and receive z=0 from south
-    MPI_Sendrecv(&local_data[l2i(1, 0, size_z)], 1, xy_face_type, north, 1,
-                 &local_data[l2i(1, 0, 0)], 1, xy_face_type, south, 1,
-                 cart_comm, &st);
+    MPI_Sendrecv(data, 1, xy_face_type[2], north, 1, data, 1, xy_face_type[0],
+                 south, 1, cart_comm, &st);
     // Send XY face z=1 to south and receive z=size_z+1 from north
-    MPI_Sendrecv(&local_data[l2i(1, 0, 1)], 1, xy_face_type, south, 1,
-                 &local_data[l2i(1, 0, size_z + 1)], 1, xy_face_type, north, 1,
-                 cart_comm, &st);
+    MPI_Sendrecv(data, 1, xy_face_type[1], south, 1, data, 1, xy_face_type[3],
+                 north, 1, cart_comm, &st);
 }
 
-void GrayScott::exchange_xz(std::vector<MemLayout> &local_data) const
+void GrayScott::exchange_xz(std::vector<double> &local_data) const
 {
     MPI_Status st;
+    double *data = local_data.data();
 
     // Send XZ face y=size_y to up and receive y=0 from down
-    MPI_Sendrecv(&local_data[l2i(1, size_y, 1)], 1, xz_face_type, up, 2,
-                 &local_data[l2i(1, 0, 1)], 1, xz_face_type, down, 2, cart_comm,
-                 &st);
+    MPI_Sendrecv(data, 1, xz_face_type[2], up, 2, data, 1, xz_face_type[0],
+                 down, 2, cart_comm, &st);
     // Send XZ face y=1 to down and receive y=size_y+1 from up
-    MPI_Sendrecv(&local_data[l2i(1, 1, 1)], 1, xz_face_type, down, 2,
-                 &local_data[l2i(1, size_y + 1, 1)], 1, xz_face_type, up, 2,
-                 cart_comm, &st);
+    MPI_Sendrecv(data, 1, xz_face_type[1], down, 2, data, 1, xz_face_type[3],
+                 up, 2, cart_comm, &st);
 }
 
-void GrayScott::exchange_yz(std::vector<MemLayout> &local_data) const
+void GrayScott::exchange_yz(std::vector<double> &local_data) const
 {
     MPI_Status st;
+    double *data = local_data.data();
 
     // Send YZ face x=size_x to east and receive x=0 from west
-    MPI_Sendrecv(&local_data[l2i(size_x, 0, 0)], 1, yz_face_type, east, 3,
-                 &local_data[l2i(0, 0, 0)], 1, yz_face_type, west, 3, cart_comm,
-                 &st);
+    MPI_Sendrecv(data, 1, yz_face_type[2], east, 3, data, 1, yz_face_type[0],
+                 west, 3, cart_comm, &st);
     // Send YZ face x=1 to west and receive x=size_x+1 from east
-    MPI_Sendrecv(&local_data[l2i(1, 0, 0)], 1, yz_face_type, west, 3,
-                 &local_data[l2i(size_x + 1, 0, 0)], 1, yz_face_type, east, 3,
-                 cart_comm, &st);
+    MPI_Sendrecv(data, 1, yz_face_type[1], west, 3, data, 1, yz_face_type[3],
+                 east, 3, cart_comm, &st);
 }
 
-void GrayScott::exchange(std::vector<MemLayout> &d) const
+void GrayScott::exchange(std::vector<double> &d) const
 {
     exchange_xy(d);
     exchange_xz(d);
     exchange_yz(d);
 }
-
-void GrayScott::data_no_ghost_common(const std::vector<MemLayout> &data,
-                                     MemLayout *data_no_ghost) const
-{
-    for (int z = 1; z < size_z + 1; z++)
-    {
-        for (int y = 1; y < size_y + 1; y++)
-        {
-            for (int x = 1; x < size_x + 1; x++)
-            {
-                data_no_ghost[(x - 1) + (y - 1) * size_x +
-                              (z - 1) * size_x * size_y] = data[l2i(x, y, z)];
-            }
-        }
-    }
-}
@@ -19,6 +19,9 @@ public:
     size_t size_x, size_y, size_z;
     // Offset of local array in the global array
     size_t offset_x, offset_y, offset_z;
+    // Cells in a row of the local array with ghosts, size_x + 2 rounded up to
+    // whole blocks of the layout
+    size_t padded_x;
 
     GrayScott(const Settings &settings, MPI_Comm comm);
     ~GrayScott();
@@ -30,29 +33,39 @@ public:
 
     void init();
     void iterate();
-    void restart(std::vector<MemLayout> &d);
+    void restart(std::vector<double> &d);
 
-    const std::vector<MemLayout> &d_ghost() const;
+    // Field array with ghosts in the layout of settings.aosoa_width, an
+    // array of MemLayout when that is 1
+    const std::vector<double> &d_ghost() const;
 
+    // Interior as an array of MemLayout, whatever the layout
     std::vector<MemLayout> d_noghost() const;
 
     void d_noghost(MemLayout *d_no_ghost) const;
 
+    // Interior u and v in separate arrays, in one pass over the ghosted data
+    void uv_noghost(double *u_no_ghost, double *v_no_ghost) const;
+
 protected:
     Settings settings;
 
-    std::vector<MemLayout> d, d2;
+    // Cells per block of the layout, settings.aosoa_width
+    size_t width;
+    std::vector<double> d, d2;
+    // Noise of the cells of one row, drawn before the row is computed
+    std::vector<double> noise_row;
 
     int rank, procs;
     int west, east, up, down, north, south;
     MPI_Comm comm;
     MPI_Comm cart_comm;
 
-    // MPI datatypes for halo exchange
-    MPI_Datatype memlayout_type;
-    MPI_Datatype xy_face_type;
-    MPI_Datatype xz_face_type;
-    MPI_Datatype yz_face_type;
+    // MPI datatypes for halo exchange, the u and v of a face at the start of
+    // the field array. For the planes 0, 1, size and size + 1 of each axis.
+    MPI_Datatype xy_face_type[4];
+    MPI_Datatype xz_face_type[4];
+    MPI_Datatype yz_face_type[4];
 
     std::random_device rand_dev;
     std::mt19937 mt_gen;
@@ -64,31 +77,27 @@ protected:
     void init_field();
 
     // Progess simulation for one timestep
-    void calc(const std::vector<MemLayout> &d, std::vector<MemLayout> &d2);
+    void calc(const std::vector<double> &d, std::vector<double> &d2);
+    // calc for blocks of W cells, one block at a time
+    template <int W>
+    void calc_layout(const std::vector<double> &d, std::vector<double> &d2);
     // Compute reaction term for U
     double calcU(double tu, double tv) const;
     // Compute reaction term for V
     double calcV(double tu, double tv) const;
-    // Compute laplacian of field s at (ix, iy, iz)
-    MemLayout laplacian(int ix, int iy, int iz,
-                        const std::vector<MemLayout> &s) const;
+
+    // Type of the u and v of the cells [x0, x1) x [y0, y1) x [z0, z1)
+    MPI_Datatype face_type(int x0, int x1, int y0, int y1, int z0,
+                           int z1) const;
 
     // Exchange faces with neighbors
-    void exchange(std::vector<MemLayout> &d) const;
+    void exchange(std::vector<double> &d) const;
     // Exchange XY faces with north/south
-    void exchange_xy(std::vector<MemLayout> &local_data) const;
+    void exchange_xy(std::vector<double> &local_data) const;
     // Exchange XZ faces with up/down
-    void exchange_xz(std::vector<MemLayout> &local_data) const;
+    void exchange_xz(std::vector<double> &local_data) const;
     // Exchange YZ faces with west/east
-    void exchange_yz(std::vector<MemLayout> &local_data) const;
-
-    // Return a copy of data with ghosts removed
-    std::vector<MemLayout>
-    data_noghost(const std::vector<MemLayout> &data) const;
-
-    // pointer version
-    void data_noghost(const std::vector<MemLayout> &data,
-                      MemLayout *no_ghost) const;
+    void exchange_yz(std::vector<double> &local_data) const;
 
     // Check if point is included in my subdomain
     inline bool is_inside(int x, int y, int z) const
@@ -120,12 +129,17 @@ protected:
     // Convert local coordinate to local index
     inline int l2i(int x, int y, int z) const
     {
-        return x + y * (size_x + 2) + z * (size_x + 2) * (size_y + 2);
+        return x + y * padded_x + z * padded_x * (size_y + 2);
     }
-
-private:
-    void data_no_ghost_common(const std::vector<MemLayout> &data,
-                              MemLayout *data_no_ghost) const;
+    // Position of u and v of the cell at local index i in the field array.
+    // Cells are stored in blocks of width, the u of all cells of the block
+    // followed by their v (AoSoA), so the stencil reads u and v at unit
+    // stride. A width of 1 is one MemLayout per cell (AoS).
+    inline size_t iu(size_t i) const
+    {
+        return (i / width) * 2 * width + i % width;
+    }
+    inline size_t iv(size_t i) const { return iu(i) + width; }
 };
 
 #endif
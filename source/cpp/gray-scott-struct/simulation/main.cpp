@@ -46,6 +46,15 @@ void print_settings(const Settings &s, int restart_step)
     std::cout << "noise:            " << s.noise << std::endl;
     std::cout << "output:           " << s.output << std::endl;
     std::cout << "adios_config:     " << s.adios_config << std::endl;
+    if (s.aosoa_width > 1)
+    {
+        std::cout << "layout:           AoSoA, blocks of " << s.aosoa_width
+                  << " cells" << std::endl;
+    }
+    else
+    {
+        std::cout << "layout:           AoS" << std::endl;
+    }
 }
 
 void print_simulator_settings(const GrayScott &s)
@@ -81,7 +90,7 @@ int main(int argc, char **argv)
         MPI_Abort(MPI_COMM_WORLD, -1);
     }
 
-    Settings settings = Settings::from_json(argv[1]);
+    Settings settings = Settings::from_json(argv[1], comm);
 
     GrayScott sim(settings, comm);
     sim.init();
@@ -98,7 +107,7 @@ int main(int argc, char **argv)
                              std::to_string(restart_step / settings.plotgap));
     }
 
-    Writer writer_main(settings, sim, io_main);
+    Writer writer_main(settings, sim, adios, io_main);
     writer_main.open(settings.output, (restart_step > 0));
 
     if (rank == 0)
@@ -122,6 +131,8 @@ int main(int argc, char **argv)
     log << "step\ttotal_gs\tcompute_gs\twrite_gs" << std::endl;
 #endif
 
+    Timer timer_iterate;
+
     for (int it = restart_step; it < settings.steps;)
     {
 #ifdef ENABLE_TIMERS
@@ -130,7 +141,9 @@ int main(int argc, char **argv)
         timer_compute.start();
 #endif
 
+        timer_iterate.start();
         sim.iterate();
+        timer_iterate.stop();
         it++;
 
 #ifdef ENABLE_TIMERS
@@ -169,6 +182,16 @@ int main(int argc, char **argv)
 
     writer_main.close();
 
+    double compute_time = timer_iterate.elapsed() / 1000.0;
+    double compute_time_max = 0.0;
+    MPI_Reduce(&compute_time, &compute_time_max, 1, MPI_DOUBLE, MPI_MAX, 0,
+               comm);
+    if (rank == 0)
+    {
+        std::cout << "Computation time (max):   " << compute_time_max
+                  << " seconds" << std::endl;
+    }
+
 #ifdef ENABLE_TIMERS
     log << "total\t" << timer_total.elapsed() << "\t" << timer_compute.elapsed()
         << "\t" << timer_write.elapsed() << std::endl;
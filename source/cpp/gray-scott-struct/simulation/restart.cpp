@@ -1,6 +1,8 @@
 #include "restart.h"
 
 #include <iostream>
+#include <stdexcept>
+#include <string>
 
 static bool firstCkpt = true;
 
@@ -20,10 +22,11 @@ void WriteCkpt(MPI_Comm comm, const int step, const Settings &settings,
     {
         adios2::Variable<DataType> var_uv;
         adios2::Variable<int> var_step;
+        adios2::Variable<int> var_width;
 
         if (firstCkpt)
         {
-            size_t X = sim.size_x + 2;
+            size_t X = sim.padded_x;
             size_t Y = sim.size_y + 2;
             size_t Z = sim.size_z + 2;
             size_t R = static_cast<size_t>(rank);
@@ -33,15 +36,20 @@ void WriteCkpt(MPI_Comm comm, const int step, const Settings &settings,
                                                  {R, 0, 0, 0}, {1, X, Y, Z});
 
             var_step = io.DefineVariable<int>("step");
+            var_width = io.DefineVariable<int>("aosoa_width");
             firstCkpt = false;
         }
         else
         {
             var_uv = io.InquireVariable<DataType>("UV");
             var_step = io.InquireVariable<int>("step");
+            var_width = io.InquireVariable<int>("aosoa_width");
         }
 
+        // Each complex is u and v of one cell in the AoS layout, in the
+        // AoSoA layout the checkpoint is only read back with the same width
         writer.Put<int>(var_step, &step);
+        writer.Put<int>(var_width, &settings.aosoa_width);
         const DataType *ptr =
             reinterpret_cast<const DataType *>(sim.d_ghost().data());
         writer.Put<DataType>(var_uv, ptr);
@@ -68,14 +76,30 @@ int ReadRestart(MPI_Comm comm, const Settings &settings, GrayScott &sim,
     {
         adios2::Variable<int> var_step = io.InquireVariable<int>("step");
         adios2::Variable<DataType> var_uv = io.InquireVariable<DataType>("UV");
-        size_t X = sim.size_x + 2;
+        adios2::Variable<int> var_width = io.InquireVariable<int>("aosoa_width");
+        size_t X = sim.padded_x;
         size_t Y = sim.size_y + 2;
         size_t Z = sim.size_z + 2;
         size_t R = static_cast<size_t>(rank);
-        std::vector<GrayScott::MemLayout> uv(X * Y * Z);
+        std::vector<double> uv(2 * X * Y * Z);
 
-        var_uv.SetSelection({{R, 0, 0, 0}, {1, X, Y, Z}});
+        // Checkpoints from before aosoa_width are AoS
+        int width = 1;
+        if (var_width)
+        {
+            reader.Get<int>(var_width, width);
+        }
         reader.Get<int>(var_step, step);
+        reader.PerformGets();
+        if (width != settings.aosoa_width)
+        {
+            throw std::runtime_error(
+                "Restart with aosoa_width " +
+                std::to_string(settings.aosoa_width) +
+                " from a checkpoint written with " + std::to_string(width));
+        }
+
+        var_uv.SetSelection({{R, 0, 0, 0}, {1, X, Y, Z}});
         reader.Get<DataType>(var_uv, reinterpret_cast<DataType *>(uv.data()));
         reader.Close();
 
@@ -1,6 +1,7 @@
 #include "settings.h"
 
 #include <fstream>
+#include <sstream>
 
 #include "json.hpp"
 
@@ -24,6 +25,8 @@ void to_json(nlohmann::json &j, const Settings &s)
                        {"adios_config", s.adios_config},
                        {"adios_span", s.adios_span},
                        {"adios_memory_selection", s.adios_memory_selection},
+                       {"adios_struct", s.adios_struct},
+                       {"aosoa_width", s.aosoa_width},
                        {"mesh_type", s.mesh_type}};
 }
 
@@ -48,6 +51,8 @@ void from_json(const nlohmann::json &j, Settings &s)
     j.at("adios_span").get_to(s.adios_span);
     j.at("adios_memory_selection").get_to(s.adios_memory_selection);
     j.at("mesh_type").get_to(s.mesh_type);
+    s.adios_struct = j.value("adios_struct", s.adios_struct);
+    s.aosoa_width = j.value("aosoa_width", s.aosoa_width);
 }
 
 Settings::Settings()
@@ -70,6 +75,8 @@ Settings::Settings()
     adios_config = "adios2.xml";
     adios_span = false;
     adios_memory_selection = false;
+    adios_struct = false;
+    aosoa_width = 1;
     mesh_type = "image";
 }
 
@@ -82,3 +89,27 @@ Settings Settings::from_json(const std::string &fname)
 
     return j.get<Settings>();
 }
+
+Settings Settings::from_json(const std::string &fname, MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    // Only rank 0 touches the (shared) filesystem, at scale every rank
+    // opening the same small file is a metadata storm
+    std::string contents;
+    unsigned long long len = 0;
+    if (rank == 0)
+    {
+        std::ifstream ifs(fname);
+        std::ostringstream ss;
+        ss << ifs.rdbuf();
+        contents = ss.str();
+        len = contents.size();
+    }
+    MPI_Bcast(&len, 1, MPI_UNSIGNED_LONG_LONG, 0, comm);
+    contents.resize(len);
+    MPI_Bcast(&contents[0], static_cast<int>(len), MPI_CHAR, 0, comm);
+
+    return nlohmann::json::parse(contents).get<Settings>();
+}
@@ -3,6 +3,8 @@
 
 #include <string>
 
+#include <mpi.h>
+
 struct Settings
 {
     size_t L;
@@ -23,10 +25,14 @@ struct Settings
     std::string adios_config;
     bool adios_span;
     bool adios_memory_selection;
+    bool adios_struct;
+    int aosoa_width;
     std::string mesh_type;
 
     Settings();
     static Settings from_json(const std::string &fname);
+    // Rank 0 reads the file and broadcasts its contents to the other ranks
+    static Settings from_json(const std::string &fname, MPI_Comm comm);
 };
 
 #endif
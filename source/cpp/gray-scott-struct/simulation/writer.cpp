@@ -1,5 +1,7 @@
 #include "writer.h"
 
+#include <cstddef>
+
 void define_bpvtk_attribute(const Settings &s, adios2::IO &io)
 {
     auto lf_VTKImage = [](const Settings &s, adios2::IO &io) {
@@ -41,7 +43,8 @@ void define_bpvtk_attribute(const Settings &s, adios2::IO &io)
     // TODO extend to other formats e.g. structured
 }
 
-Writer::Writer(const Settings &settings, const GrayScott &sim, adios2::IO io)
+Writer::Writer(const Settings &settings, const GrayScott &sim,
+               adios2::ADIOS &ad, adios2::IO io)
 : settings(settings), io(io)
 {
     io.DefineAttribute<double>("F", settings.F);
@@ -50,28 +53,53 @@ Writer::Writer(const Settings &settings, const GrayScott &sim, adios2::IO io)
     io.DefineAttribute<double>("Du", settings.Du);
     io.DefineAttribute<double>("Dv", settings.Dv);
     io.DefineAttribute<double>("noise", settings.noise);
-    // define VTK visualization schema as an attribute
-    if (!settings.mesh_type.empty())
+    // define VTK visualization schema as an attribute, it can only describe
+    // U and V as separate arrays
+    if (!settings.mesh_type.empty() && !settings.adios_struct)
     {
         define_bpvtk_attribute(settings, io);
     }
 
-    var_u =
-        io.DefineVariable<double>("U", {settings.L, settings.L, settings.L},
-                                  {sim.offset_z, sim.offset_y, sim.offset_x},
-                                  {sim.size_z, sim.size_y, sim.size_x});
-
-    var_v =
-        io.DefineVariable<double>("V", {settings.L, settings.L, settings.L},
-                                  {sim.offset_z, sim.offset_y, sim.offset_x},
-                                  {sim.size_z, sim.size_y, sim.size_x});
-
-    if (settings.adios_memory_selection)
+    if (settings.adios_struct)
     {
-        var_u.SetMemorySelection(
-            {{1, 1, 1}, {sim.size_z + 2, sim.size_y + 2, sim.size_x + 2}});
-        var_v.SetMemorySelection(
-            {{1, 1, 1}, {sim.size_z + 2, sim.size_y + 2, sim.size_x + 2}});
+        adios2::StructDefinition def =
+            ad.DefineStruct("MemLayout", sizeof(GrayScott::MemLayout));
+        def.AddField("u", offsetof(GrayScott::MemLayout, u),
+                     adios2::DataType::Double);
+        def.AddField("v", offsetof(GrayScott::MemLayout, v),
+                     adios2::DataType::Double);
+
+        var_uv = io.DefineStructVariable(
+            "UV", def, {settings.L, settings.L, settings.L},
+            {sim.offset_z, sim.offset_y, sim.offset_x},
+            {sim.size_z, sim.size_y, sim.size_x});
+
+        // The interior of the ghosted array, nothing is copied before Put.
+        // The AoSoA layout is staged as MemLayout first.
+        if (settings.aosoa_width == 1)
+        {
+            var_uv.SetMemorySelection(
+                {{1, 1, 1}, {sim.size_z + 2, sim.size_y + 2, sim.padded_x}});
+        }
+        else
+        {
+            uv.resize(sim.size_x * sim.size_y * sim.size_z);
+        }
+    }
+    else
+    {
+        var_u = io.DefineVariable<double>(
+            "U", {settings.L, settings.L, settings.L},
+            {sim.offset_z, sim.offset_y, sim.offset_x},
+            {sim.size_z, sim.size_y, sim.size_x});
+
+        var_v = io.DefineVariable<double>(
+            "V", {settings.L, settings.L, settings.L},
+            {sim.offset_z, sim.offset_y, sim.offset_x},
+            {sim.size_z, sim.size_y, sim.size_x});
+
+        u.resize(sim.size_x * sim.size_y * sim.size_z);
+        v.resize(u.size());
     }
 
     var_step = io.DefineVariable<int>("step");
@@ -96,52 +124,24 @@ void Writer::write(int step, const GrayScott &sim)
         return;
     }
 
-    /*if (settings.adios_memory_selection)
+    writer.BeginStep();
+    writer.Put<int>(var_step, &step);
+    if (settings.adios_struct && settings.aosoa_width == 1)
     {
-        const std::vector<double> &u = sim.u_ghost();
-        const std::vector<double> &v = sim.v_ghost();
-
-        writer.BeginStep();
-        writer.Put<int>(var_step, &step);
-        writer.Put<double>(var_u, u.data());
-        writer.Put<double>(var_v, v.data());
-        writer.EndStep();
+        writer.Put(var_uv, sim.d_ghost().data());
     }
-    else if (settings.adios_span)
+    else if (settings.adios_struct)
     {
-        writer.BeginStep();
-
-        writer.Put<int>(var_step, &step);
-
-        // provide memory directly from adios buffer
-        adios2::Variable<double>::Span u_span = writer.Put<double>(var_u);
-        adios2::Variable<double>::Span v_span = writer.Put<double>(var_v);
-
-        // populate spans
-        sim.u_noghost(u_span.data());
-        sim.v_noghost(v_span.data());
-
-        writer.EndStep();
+        sim.d_noghost(uv.data());
+        writer.Put(var_uv, uv.data());
     }
-    else*/
+    else
     {
-        /* Copy 1 */
-        std::vector<GrayScott::MemLayout> d = sim.d_noghost();
-        /* Copy 2*/
-        std::vector<double> u(d.size());
-        std::vector<double> v(d.size());
-        for (size_t i = 0; i < d.size(); ++i)
-        {
-            u[i] = d[i].u;
-            v[i] = d[i].v;
-        }
-
-        writer.BeginStep();
-        writer.Put<int>(var_step, &step);
+        sim.uv_noghost(u.data(), v.data());
         writer.Put<double>(var_u, u.data());
         writer.Put<double>(var_v, v.data());
-        writer.EndStep();
     }
+    writer.EndStep();
 }
 
 void Writer::close() { writer.Close(); }
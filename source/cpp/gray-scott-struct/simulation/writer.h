@@ -1,6 +1,8 @@
 #ifndef __WRITER_H__
 #define __WRITER_H__
 
+#include <vector>
+
 #include <adios2.h>
 #include <mpi.h>
 
@@ -10,7 +12,8 @@
 class Writer
 {
 public:
-    Writer(const Settings &settings, const GrayScott &sim, adios2::IO io);
+    Writer(const Settings &settings, const GrayScott &sim, adios2::ADIOS &ad,
+           adios2::IO io);
     void open(const std::string &fname, bool append);
     void write(int step, const GrayScott &sim);
     void close();
@@ -20,9 +23,15 @@ protected:
 
     adios2::IO io;
     adios2::Engine writer;
+    // With adios_struct the ghosted array of MemLayout goes out as it is as
+    // UV, or staged in uv from the AoSoA layout. Otherwise it is
+    // deinterleaved into u and v as U and V.
+    adios2::VariableStruct var_uv;
     adios2::Variable<double> var_u;
     adios2::Variable<double> var_v;
     adios2::Variable<int> var_step;
+    std::vector<GrayScott::MemLayout> uv;
+    std::vector<double> u, v;
 };
 
 #endif
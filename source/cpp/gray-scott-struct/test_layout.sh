@@ -0,0 +1,50 @@
+#!/bin/bash
+
+# Compute benchmark of the field layouts: the SoA solver of gray-scott,
+# separate U and V arrays, against this one with u and v interleaved per
+# cell (AoS, aosoa_width 1) and in blocks of cells (AoSoA). Output is
+# written once at the end so that the runs time the stencil and the halo
+# exchange.
+#
+# Usage: ./test_layout.sh [processes] [L] [steps] [directory]
+
+NP=${1:-4}
+L=${2:-128}
+STEPS=${3:-200}
+DIR=${4:-/tmp/gray-scott-layout}
+
+SOA=./build/adios2-gray-scott
+AOS=./build/adios2-gray-scott-struct
+for exe in "$SOA" "$AOS"; do
+    if [ ! -x "$exe" ]; then
+        echo "Error: $exe not found, build the examples first"
+        exit 1
+    fi
+done
+
+mkdir -p "$DIR"
+
+source "$(dirname "$0")/../gray-scott/benchmark_settings.sh"
+
+run() {
+    local name=$1
+    local exe=$2
+    local width=$3
+    local settings="$DIR/settings-$name.json"
+    write_settings "$settings" "$L" "$STEPS" "$STEPS" "$DIR/gs-$name.bp" \
+        "\"aosoa_width\": $width"
+    rm -rf "$DIR/gs-$name.bp"
+    printf "%-12s " "$name"
+    mpirun -n "$NP" "$exe" "$settings" | grep "Computation time"
+}
+
+echo "========================================"
+echo "Gray-Scott field layout benchmark"
+echo "$NP processes, L = $L, $STEPS steps, in $DIR"
+echo "========================================"
+
+run soa "$SOA" 1
+run aos "$AOS" 1
+for width in 2 4 8 16; do
+    run "aosoa-$width" "$AOS" "$width"
+done
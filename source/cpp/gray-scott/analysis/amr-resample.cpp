@@ -0,0 +1,248 @@
+/*
+ * Analysis code for the Gray-Scott application.
+ * Reads the coarse U and V and the refined patches of a simulation run with
+ * "amr": true, and writes U and V on a uniform grid at the fine resolution,
+ * so the other analysis codes can read them unchanged.
+ *
+ * Coarse cells not covered by a patch are repeated ratio^3 times.
+ *
+ */
+#include <mpi.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "adios2.h"
+
+#include "../../../common/block-decomp.hpp"
+
+void printUsage()
+{
+    std::cout
+        << "Usage: amr_resample input output\n"
+        << "  input:   Name of the input file handle for reading data\n"
+        << "  output:  Name of the output file to which data must be written\n\n";
+}
+
+/*
+ * MAIN
+ */
+int main(int argc, char *argv[])
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+    int rank, comm_size, wrank;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &wrank);
+
+    const unsigned int color = 8;
+    MPI_Comm comm;
+    MPI_Comm_split(MPI_COMM_WORLD, color, wrank, &comm);
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &comm_size);
+
+    if (argc < 3)
+    {
+        std::cout << "Not enough arguments\n";
+        if (rank == 0)
+            printUsage();
+        MPI_Finalize();
+        return 0;
+    }
+
+    std::string in_filename = argv[1];
+    std::string out_filename = argv[2];
+
+    {
+        adios2::ADIOS ad("adios2.xml", comm);
+
+        adios2::IO reader_io = ad.DeclareIO("SimulationOutput");
+        adios2::IO writer_io = ad.DeclareIO("ResampleOutput");
+
+        adios2::Engine reader =
+            reader_io.Open(in_filename, adios2::Mode::Read, comm);
+        adios2::Engine writer =
+            writer_io.Open(out_filename, adios2::Mode::Write, comm);
+
+        adios2::Variable<double> var_u_out, var_v_out;
+        adios2::Variable<int> var_step_out;
+
+        while (true)
+        {
+            adios2::StepStatus read_status =
+                reader.BeginStep(adios2::StepMode::Read, 10.0f);
+            if (read_status == adios2::StepStatus::NotReady)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+                continue;
+            }
+            else if (read_status != adios2::StepStatus::OK)
+            {
+                break;
+            }
+
+            adios2::Variable<double> var_u = reader_io.InquireVariable<double>("U");
+            adios2::Variable<double> var_v = reader_io.InquireVariable<double>("V");
+            adios2::Variable<int> var_step = reader_io.InquireVariable<int>("step");
+            adios2::Variable<uint64_t> var_boxes =
+                reader_io.InquireVariable<uint64_t>("fine_boxes");
+            adios2::Variable<double> var_u_fine =
+                reader_io.InquireVariable<double>("U_fine");
+            adios2::Variable<double> var_v_fine =
+                reader_io.InquireVariable<double>("V_fine");
+
+            // Steps without U or V (output_u_every, output_v_every) are
+            // left out
+            if (!var_u || !var_v ||
+                reader.BlocksInfo(var_u, reader.CurrentStep()).empty() ||
+                reader.BlocksInfo(var_v, reader.CurrentStep()).empty())
+            {
+                reader.EndStep();
+                continue;
+            }
+
+            size_t r = 1;
+            adios2::Attribute<int> attr_ratio =
+                reader_io.InquireAttribute<int>("refinement_ratio");
+            if (attr_ratio)
+            {
+                r = static_cast<size_t>(attr_ratio.Data().front());
+            }
+
+            // Coarse grid L^3, fine grid N^3, decomposed along the slowest
+            // dimension
+            const adios2::Dims shape = var_u.Shape();
+            const size_t L = shape[0];
+            const size_t N = r * L;
+            size_t z_start, z_count;
+            decomp::block_1d(N, comm_size, rank, z_start, z_count);
+
+            if (!var_u_out)
+            {
+                var_u_out = writer_io.DefineVariable<double>(
+                    "U", {N, N, N}, {z_start, 0, 0}, {z_count, N, N});
+                var_v_out = writer_io.DefineVariable<double>(
+                    "V", {N, N, N}, {z_start, 0, 0}, {z_count, N, N});
+                var_step_out = writer_io.DefineVariable<int>("step");
+            }
+
+            // Coarse planes under the local fine planes
+            const size_t cz0 = z_start / r;
+            const size_t cz1 = z_count ? (z_start + z_count - 1) / r + 1
+                                       : cz0;
+            std::vector<double> cu, cv;
+            int step = 0;
+            var_u.SetSelection({{cz0, 0, 0}, {cz1 - cz0, L, L}});
+            var_v.SetSelection({{cz0, 0, 0}, {cz1 - cz0, L, L}});
+            if (cz1 > cz0)
+            {
+                reader.Get<double>(var_u, cu);
+                reader.Get<double>(var_v, cv);
+            }
+            reader.Get<int>(var_step, &step);
+
+            // The rows of fine_boxes list the patches in the order of the
+            // U_fine/V_fine blocks: coarse start and count, (z, y, x)
+            std::vector<uint64_t> boxes;
+            if (var_boxes)
+            {
+                for (const auto &info :
+                     reader.BlocksInfo(var_boxes, reader.CurrentStep()))
+                {
+                    std::vector<uint64_t> rows;
+                    var_boxes.SetBlockSelection(info.BlockID);
+                    reader.Get<uint64_t>(var_boxes, rows, adios2::Mode::Sync);
+                    boxes.insert(boxes.end(), rows.begin(), rows.end());
+                }
+            }
+
+            // Patches overlapping the local fine planes
+            std::vector<size_t> patch_ids;
+            std::vector<std::vector<double>> pu, pv;
+            for (size_t p = 0; p < boxes.size() / 6; p++)
+            {
+                const uint64_t *box = &boxes[6 * p];
+                if (r * box[0] < z_start + z_count &&
+                    r * (box[0] + box[3]) > z_start)
+                {
+                    patch_ids.push_back(p);
+                }
+            }
+            pu.resize(patch_ids.size());
+            pv.resize(patch_ids.size());
+            for (size_t k = 0; k < patch_ids.size(); k++)
+            {
+                var_u_fine.SetBlockSelection(patch_ids[k]);
+                reader.Get<double>(var_u_fine, pu[k]);
+                var_v_fine.SetBlockSelection(patch_ids[k]);
+                reader.Get<double>(var_v_fine, pv[k]);
+            }
+            reader.EndStep();
+
+            std::vector<double> u(z_count * N * N), v(z_count * N * N);
+            for (size_t z = 0; z < z_count; z++)
+            {
+                const size_t cz = (z_start + z) / r - cz0;
+                for (size_t y = 0; y < N; y++)
+                {
+                    for (size_t x = 0; x < N; x++)
+                    {
+                        const size_t c = (cz * L + y / r) * L + x / r;
+                        u[(z * N + y) * N + x] = cu[c];
+                        v[(z * N + y) * N + x] = cv[c];
+                    }
+                }
+            }
+            for (size_t k = 0; k < patch_ids.size(); k++)
+            {
+                const uint64_t *box = &boxes[6 * patch_ids[k]];
+                const size_t z0 = r * box[0], y0 = r * box[1], x0 = r * box[2];
+                const size_t nz = r * box[3], ny = r * box[4], nx = r * box[5];
+                const size_t zb = std::max(z0, z_start);
+                const size_t ze = std::min(z0 + nz, z_start + z_count);
+                for (size_t z = zb; z < ze; z++)
+                {
+                    for (size_t y = 0; y < ny; y++)
+                    {
+                        const size_t src = ((z - z0) * ny + y) * nx;
+                        const size_t dst =
+                            ((z - z_start) * N + y0 + y) * N + x0;
+                        std::copy(&pu[k][src], &pu[k][src] + nx, &u[dst]);
+                        std::copy(&pv[k][src], &pv[k][src] + nx, &v[dst]);
+                    }
+                }
+            }
+
+            writer.BeginStep();
+            if (!rank)
+            {
+                writer.Put<int>(var_step_out, &step);
+            }
+            if (z_count)
+            {
+                writer.Put<double>(var_u_out, u.data());
+                writer.Put<double>(var_v_out, v.data());
+            }
+            writer.EndStep();
+
+            if (!rank)
+            {
+                std::cout << "Resampled step " << step << ": " << L << "^3 and "
+                          << boxes.size() / 6 << " patches to " << N << "^3"
+                          << std::endl;
+            }
+        }
+
+        reader.Close();
+        writer.Close();
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,774 @@
+/*
+ * Analysis host for the Gray-Scott simulation.
+ * Reads U and V of every output step once and runs several analysis modules
+ * (PDF, reductions, isosurface) on the same in-memory step concurrently.
+ * Every module writes its own output with an ADIOS2 instance of its own, so
+ * the module threads and the reading main thread share no ADIOS2 state.
+ *
+ */
+#include <mpi.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "adios2.h"
+
+#include "../../../common/block-decomp.hpp"
+#include "../../gray-scott/analysis/pdf.hpp"
+#include "../../gray-scott/common/segments.hpp"
+
+#ifdef GRAY_SCOTT_HAVE_VTK
+#include <vtkAppendPolyData.h>
+#include <vtkDoubleArray.h>
+
+#include "../../gray-scott/analysis/isosurface.hpp"
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point t)
+{
+    return std::chrono::duration<double>(Clock::now() - t).count();
+}
+
+// One step of the simulation output as read by this rank: the z-planes
+// [start, start + count) of U and V, followed by ghost planes of overlap
+// with the next rank for the modules that need them. The simulation may
+// leave U or V out of a step. Modules only read it.
+struct StepData
+{
+    size_t step = 0;
+    int sim_step = 0;
+    bool has_u = false;
+    bool has_v = false;
+    adios2::Dims shape;
+    size_t start = 0;
+    size_t count = 0;
+    size_t ghost = 0;
+    std::vector<double> u;
+    std::vector<double> v;
+};
+
+// An analysis run by the host. open() is called on the main thread, in the
+// same order on all ranks, process() on the thread of the module, one step
+// after the other.
+class Module
+{
+public:
+    Module(const std::string &name, const std::string &output)
+    : name(name), output(output)
+    {
+    }
+    virtual ~Module() {}
+
+    // comm is the module's own communicator, for its output and reductions.
+    // config is the ADIOS2 XML file of the module's ADIOS2 instance.
+    virtual void open(const std::string &config, MPI_Comm comm) = 0;
+    virtual void process(const StepData &data) = 0;
+    // Before MPI_Finalize, the ADIOS2 instance goes with the output
+    virtual void close()
+    {
+        writer.Close();
+        adios.reset();
+    }
+
+    // Planes of overlap with the next rank the module needs
+    virtual size_t ghost() const { return 0; }
+
+    std::string name;
+    std::string output;
+    double compute_time = 0.0;
+    double write_time = 0.0;
+
+protected:
+    MPI_Comm comm;
+    int rank = 0;
+    std::unique_ptr<adios2::ADIOS> adios;
+    adios2::IO io;
+    adios2::Engine writer;
+
+    void open_output(const std::string &config, const std::string &io_name,
+                     MPI_Comm comm)
+    {
+        this->comm = comm;
+        MPI_Comm_rank(comm, &rank);
+        adios.reset(new adios2::ADIOS(config, comm));
+        io = adios->DeclareIO(io_name);
+        writer = io.Open(output, adios2::Mode::Write, comm);
+    }
+};
+
+// The PDF of every z-plane of U and V, as written by adios2-pdf-calc
+class PdfModule : public Module
+{
+public:
+    PdfModule(const std::string &output, size_t nbins)
+    : Module("pdf", output), nbins(nbins)
+    {
+    }
+
+    void open(const std::string &config, MPI_Comm comm) override
+    {
+        open_output(config, "PDFAnalysisOutput", comm);
+    }
+
+    void process(const StepData &d) override
+    {
+        Clock::time_point t = Clock::now();
+
+        const size_t n = d.count * d.shape[1] * d.shape[2];
+        std::vector<double> pdf_u, bins_u, pdf_v, bins_v;
+        if (d.has_u)
+        {
+            pdf(d.u, n, d, pdf_u, bins_u);
+        }
+        if (d.has_v)
+        {
+            pdf(d.v, n, d, pdf_v, bins_v);
+        }
+        compute_time += seconds_since(t);
+
+        t = Clock::now();
+        if (!var_u_pdf)
+        {
+            var_u_pdf = io.DefineVariable<double>("U/pdf", {d.shape[0], nbins},
+                                                  {0, 0}, {0, nbins});
+            var_v_pdf = io.DefineVariable<double>("V/pdf", {d.shape[0], nbins},
+                                                  {0, 0}, {0, nbins});
+            if (!rank)
+            {
+                var_u_bins = io.DefineVariable<double>("U/bins", {nbins}, {0},
+                                                       {nbins});
+                var_v_bins = io.DefineVariable<double>("V/bins", {nbins}, {0},
+                                                       {nbins});
+                var_step = io.DefineVariable<int>("step");
+            }
+        }
+        // The planes of a rank follow the simulation blocks
+        var_u_pdf.SetSelection({{d.start, 0}, {d.count, nbins}});
+        var_v_pdf.SetSelection({{d.start, 0}, {d.count, nbins}});
+
+        writer.BeginStep();
+        if (d.has_u)
+        {
+            writer.Put<double>(var_u_pdf, pdf_u.data());
+        }
+        if (d.has_v)
+        {
+            writer.Put<double>(var_v_pdf, pdf_v.data());
+        }
+        if (!rank)
+        {
+            if (d.has_u)
+            {
+                writer.Put<double>(var_u_bins, bins_u.data());
+            }
+            if (d.has_v)
+            {
+                writer.Put<double>(var_v_bins, bins_v.data());
+            }
+            writer.Put<int>(var_step, d.sim_step);
+        }
+        writer.EndStep();
+        write_time += seconds_since(t);
+    }
+
+private:
+    size_t nbins;
+
+    // PDFs between the local minimum and maximum of the n values of field
+    void pdf(const std::vector<double> &field, size_t n, const StepData &d,
+             std::vector<double> &pdf, std::vector<double> &bins) const
+    {
+        std::pair<double, double> mm(0.0, 0.0);
+        if (n)
+        {
+            auto m = std::minmax_element(field.begin(), field.begin() + n);
+            mm = std::make_pair(*m.first, *m.second);
+        }
+        compute_pdf(field, d.shape, d.start, d.count, nbins, mm.first,
+                    mm.second, pdf, bins);
+    }
+    adios2::Variable<double> var_u_pdf, var_v_pdf;
+    adios2::Variable<double> var_u_bins, var_v_bins;
+    adios2::Variable<int> var_step;
+};
+
+// Global minimum, maximum, mean and L2 norm of U and V, written by rank 0
+class ReductionModule : public Module
+{
+public:
+    ReductionModule(const std::string &output) : Module("reduce", output) {}
+
+    void open(const std::string &config, MPI_Comm comm) override
+    {
+        open_output(config, "ReductionOutput", comm);
+        if (!rank)
+        {
+            const char *names[4] = {"min", "max", "mean", "norm"};
+            for (int i = 0; i < 4; i++)
+            {
+                var_u[i] =
+                    io.DefineVariable<double>(std::string("U/") + names[i]);
+                var_v[i] =
+                    io.DefineVariable<double>(std::string("V/") + names[i]);
+            }
+            var_step = io.DefineVariable<int>("step");
+        }
+    }
+
+    void process(const StepData &d) override
+    {
+        Clock::time_point t = Clock::now();
+
+        // min, max, sum, sum of squares of U then V, neutral for a field
+        // this step does not have
+        const size_t n = d.count * d.shape[1] * d.shape[2];
+        double local[8], global[8];
+        reduce(d.u.data(), d.has_u ? n : 0, local);
+        reduce(d.v.data(), d.has_v ? n : 0, local + 4);
+
+        double mins[2] = {local[0], local[4]};
+        double maxs[2] = {local[1], local[5]};
+        double sums[4] = {local[2], local[3], local[6], local[7]};
+        MPI_Reduce(mins, global, 2, MPI_DOUBLE, MPI_MIN, 0, comm);
+        MPI_Reduce(maxs, global + 2, 2, MPI_DOUBLE, MPI_MAX, 0, comm);
+        MPI_Reduce(sums, global + 4, 4, MPI_DOUBLE, MPI_SUM, 0, comm);
+
+        const double cells =
+            static_cast<double>(d.shape[0] * d.shape[1] * d.shape[2]);
+        double u[4] = {global[0], global[2], global[4] / cells,
+                       std::sqrt(global[5])};
+        double v[4] = {global[1], global[3], global[6] / cells,
+                       std::sqrt(global[7])};
+        compute_time += seconds_since(t);
+
+        t = Clock::now();
+        writer.BeginStep();
+        if (!rank)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                if (d.has_u)
+                {
+                    writer.Put<double>(var_u[i], u[i]);
+                }
+                if (d.has_v)
+                {
+                    writer.Put<double>(var_v[i], v[i]);
+                }
+            }
+            writer.Put<int>(var_step, d.sim_step);
+        }
+        writer.EndStep();
+        write_time += seconds_since(t);
+    }
+
+private:
+    adios2::Variable<double> var_u[4], var_v[4];
+    adios2::Variable<int> var_step;
+
+    static void reduce(const double *data, size_t n, double *r)
+    {
+        r[0] = n ? data[0] : std::numeric_limits<double>::max();
+        r[1] = n ? data[0] : std::numeric_limits<double>::lowest();
+        r[2] = 0.0;
+        r[3] = 0.0;
+        for (size_t i = 0; i < n; i++)
+        {
+            r[0] = std::min(r[0], data[i]);
+            r[1] = std::max(r[1], data[i]);
+            r[2] += data[i];
+            r[3] += data[i] * data[i];
+        }
+    }
+};
+
+#ifdef GRAY_SCOTT_HAVE_VTK
+// Isosurfaces of U, as written by adios2-isosurface
+class IsosurfaceModule : public Module
+{
+public:
+    IsosurfaceModule(const std::string &output,
+                     const std::vector<double> &isovalues)
+    : Module("isosurface", output), isovalues(isovalues)
+    {
+    }
+
+    void open(const std::string &config, MPI_Comm comm) override
+    {
+        open_output(config, "IsosurfaceOutput", comm);
+        var_point = io.DefineVariable<double>("point", {1, 3}, {0, 0}, {1, 3});
+        var_cell = io.DefineVariable<int>("cell", {1, 3}, {0, 0}, {1, 3});
+        var_normal =
+            io.DefineVariable<double>("normal", {1, 3}, {0, 0}, {1, 3});
+        var_step = io.DefineVariable<int>("step");
+    }
+
+    // Marching cubes needs one layer of overlap with the next block
+    size_t ghost() const override { return 1; }
+
+    void process(const StepData &d) override
+    {
+        if (!d.has_u)
+        {
+            return;
+        }
+        Clock::time_point t = Clock::now();
+
+        vtkSmartPointer<vtkPolyData> surface;
+        if (d.count + d.ghost >= 2)
+        {
+            auto append = vtkSmartPointer<vtkAppendPolyData>::New();
+            for (const auto isovalue : isovalues)
+            {
+                append->AddInputData(compute_isosurface(
+                    {d.start, 0, 0}, {d.count + d.ghost, d.shape[1], d.shape[2]},
+                    d.u, isovalue));
+            }
+            append->Update();
+            surface = append->GetOutput();
+        }
+        else
+        {
+            // No cells on this rank, it still takes part in the output
+            surface = vtkSmartPointer<vtkPolyData>::New();
+            auto normals = vtkSmartPointer<vtkDoubleArray>::New();
+            normals->SetNumberOfComponents(3);
+            surface->GetPointData()->SetNormals(normals);
+        }
+        compute_time += seconds_since(t);
+
+        t = Clock::now();
+        write_adios(writer, surface, var_point, var_cell, var_normal, var_step,
+                    d.sim_step, comm);
+        write_time += seconds_since(t);
+    }
+
+private:
+    std::vector<double> isovalues;
+    adios2::Variable<double> var_point, var_normal;
+    adios2::Variable<int> var_cell, var_step;
+};
+#endif
+
+// Runs the modules on a step. Every module has a worker thread of its own,
+// so the collective calls of a module are made in the same order on all
+// ranks whatever the others do. Without threads the modules run one after
+// the other in run().
+class ModulePool
+{
+public:
+    ModulePool(std::vector<std::unique_ptr<Module>> &modules, bool threaded)
+    : modules(modules)
+    {
+        if (threaded)
+        {
+            for (size_t m = 0; m < modules.size(); m++)
+            {
+                workers.emplace_back(&ModulePool::work, this, m);
+            }
+        }
+    }
+
+    ~ModulePool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        start.notify_all();
+        for (auto &w : workers)
+        {
+            w.join();
+        }
+    }
+
+    // Hand data to all modules, it must stay untouched until wait()
+    void run(const StepData &data)
+    {
+        if (workers.empty())
+        {
+            for (auto &m : modules)
+            {
+                m->process(data);
+            }
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = &data;
+            pending = modules.size();
+            generation++;
+        }
+        start.notify_all();
+    }
+
+    // Wait for all modules to be done with the step of the last run()
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pending == 0; });
+    }
+
+    bool threaded() const { return !workers.empty(); }
+
+private:
+    std::vector<std::unique_ptr<Module>> &modules;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+    const StepData *current = nullptr;
+    size_t generation = 0;
+    size_t pending = 0;
+    bool stop = false;
+
+    void work(size_t m)
+    {
+        size_t seen = 0;
+        while (true)
+        {
+            const StepData *data;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start.wait(lock,
+                           [&] { return stop || generation != seen; });
+                if (generation == seen)
+                {
+                    return;
+                }
+                seen = generation;
+                data = current;
+            }
+
+            modules[m]->process(*data);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0)
+            {
+                done.notify_all();
+            }
+        }
+    }
+};
+
+static std::vector<std::string> split(const std::string &s, char sep)
+{
+    std::vector<std::string> parts;
+    std::istringstream in(s);
+    std::string part;
+    while (std::getline(in, part, sep))
+    {
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+// pdf:output[:nbins], reduce:output or iso:output:isovalue[,isovalue...]
+static std::unique_ptr<Module> make_module(const std::string &spec)
+{
+    const std::vector<std::string> p = split(spec, ':');
+    if (p.size() >= 2 && p[0] == "pdf")
+    {
+        size_t nbins = 1000;
+        if (p.size() >= 3 && std::stoi(p[2]) > 0)
+        {
+            nbins = static_cast<size_t>(std::stoi(p[2]));
+        }
+        return std::unique_ptr<Module>(new PdfModule(p[1], nbins));
+    }
+    if (p.size() >= 2 && p[0] == "reduce")
+    {
+        return std::unique_ptr<Module>(new ReductionModule(p[1]));
+    }
+    if (p.size() >= 3 && p[0] == "iso")
+    {
+#ifdef GRAY_SCOTT_HAVE_VTK
+        std::vector<double> isovalues;
+        for (const auto &value : split(p[2], ','))
+        {
+            isovalues.push_back(std::stod(value));
+        }
+        return std::unique_ptr<Module>(
+            new IsosurfaceModule(p[1], isovalues));
+#else
+        throw std::invalid_argument(
+            "ERROR: the isosurface module needs a build with VTK\n");
+#endif
+    }
+    throw std::invalid_argument("ERROR: unknown module " + spec + "\n");
+}
+
+/*
+ * Print info to the user on how to invoke the application
+ */
+void printUsage()
+{
+    std::cout
+        << "Usage: analysis_host input module...\n"
+        << "  input:   Name of the input file handle for reading data\n"
+        << "  module:  Analysis to run on every step, any of\n"
+        << "             pdf:output[:N]         PDFs of the z-planes of U "
+           "and V with N bins, default = 1000\n"
+        << "             reduce:output          min, max, mean and norm of U "
+           "and V\n"
+        << "             iso:output:v1[,v2...]  isosurfaces of U (with "
+           "VTK)\n\n";
+}
+
+/*
+ * MAIN
+ */
+int main(int argc, char *argv[])
+{
+    const Clock::time_point start_total = Clock::now();
+
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+    int rank, comm_size, wrank;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &wrank);
+
+    const unsigned int color = 9;
+    MPI_Comm comm;
+    MPI_Comm_split(MPI_COMM_WORLD, color, wrank, &comm);
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &comm_size);
+
+    if (argc < 3)
+    {
+        std::cout << "Not enough arguments\n";
+        if (rank == 0)
+            printUsage();
+        MPI_Finalize();
+        return 0;
+    }
+
+    const std::string in_filename = argv[1];
+    std::vector<std::unique_ptr<Module>> modules;
+    size_t ghost = 0;
+    try
+    {
+        for (int i = 2; i < argc; i++)
+        {
+            modules.push_back(make_module(argv[i]));
+            ghost = std::max(ghost, modules.back()->ghost());
+        }
+    }
+    catch (const std::exception &e)
+    {
+        if (!rank)
+        {
+            std::cerr << e.what();
+            printUsage();
+        }
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+
+    // Modules call MPI and ADIOS2 from their own threads
+    const bool threaded = provided >= MPI_THREAD_MULTIPLE;
+    if (!rank && !threaded)
+    {
+        std::cout << "MPI_THREAD_MULTIPLE is not available, the modules run "
+                     "one after the other"
+                  << std::endl;
+    }
+
+    double read_time = 0.0;
+    size_t read_bytes = 0;
+    size_t steps = 0;
+    {
+        adios2::ADIOS ad("adios2.xml", comm);
+        adios2::IO reader_io = ad.DeclareIO("SimulationOutput");
+        if (!rank)
+        {
+            std::cout << "Analysis host reads from Simulation using engine "
+                         "type:  "
+                      << reader_io.EngineType() << std::endl;
+        }
+
+        // Every module gets its own communicator, ADIOS2 instance and
+        // output, opened here in the same order on all ranks
+        std::vector<MPI_Comm> module_comms(modules.size());
+        for (size_t m = 0; m < modules.size(); m++)
+        {
+            MPI_Comm_dup(comm, &module_comms[m]);
+            modules[m]->open("adios2.xml", module_comms[m]);
+        }
+
+        SegmentedReader segments(reader_io, in_filename, comm);
+        adios2::Engine &reader = segments.engine();
+
+        // Step k + 1 is read into one buffer while the modules work on
+        // step k in the other
+        StepData buffers[2];
+        int next = 0;
+        {
+            ModulePool pool(modules, threaded);
+            while (true)
+            {
+                const Clock::time_point start_read = Clock::now();
+
+                adios2::StepStatus read_status =
+                    segments.BeginStep(adios2::StepMode::Read, 10.0f);
+                if (read_status == adios2::StepStatus::NotReady)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+                    continue;
+                }
+                else if (read_status != adios2::StepStatus::OK)
+                {
+                    break;
+                }
+
+                StepData &d = buffers[next];
+                d.step = segments.CurrentStep();
+
+                adios2::Variable<double> var_u =
+                    segments.InquireVariable<double>("U");
+                adios2::Variable<double> var_v =
+                    segments.InquireVariable<double>("V");
+                adios2::Variable<int> var_step =
+                    reader_io.InquireVariable<int>("step");
+                if (!var_u && !var_v)
+                {
+                    reader.EndStep();
+                    continue;
+                }
+                d.has_u = static_cast<bool>(var_u);
+                d.has_v = static_cast<bool>(var_v);
+                adios2::Variable<double> &var = d.has_u ? var_u : var_v;
+                d.shape = var.Shape();
+
+                // Split the slices along the slowest dimension so that every
+                // process reads whole blocks written by the simulation
+                std::vector<size_t> starts;
+                for (const auto &info :
+                     reader.BlocksInfo(var, reader.CurrentStep()))
+                {
+                    starts.push_back(info.Start[0]);
+                }
+                decomp::aligned_1d(decomp::bounds(d.shape[0], starts),
+                                   comm_size, rank, d.start, d.count);
+                d.ghost = 0;
+                if (d.count)
+                {
+                    d.ghost = std::min(ghost,
+                                       d.shape[0] - (d.start + d.count));
+                }
+
+                const adios2::Box<adios2::Dims> box(
+                    {d.start, 0, 0},
+                    {d.count + d.ghost, d.shape[1], d.shape[2]});
+                d.u.clear();
+                d.v.clear();
+                if (d.has_u)
+                {
+                    var_u.SetSelection(box);
+                    reader.Get<double>(var_u, d.u);
+                }
+                if (d.has_v)
+                {
+                    var_v.SetSelection(box);
+                    reader.Get<double>(var_v, d.v);
+                }
+                reader.Get<int>(var_step, &d.sim_step);
+                reader.EndStep();
+
+                const double step_read_time = seconds_since(start_read);
+                read_time += step_read_time;
+                read_bytes += (d.u.size() + d.v.size()) * sizeof(double);
+
+                if (!rank)
+                {
+                    std::cout << "Analysis host step " << steps
+                              << " processing sim output step " << d.step
+                              << " sim compute step " << d.sim_step
+                              << " (read time: " << std::fixed
+                              << std::setprecision(3) << step_read_time
+                              << "s)" << std::endl;
+                }
+
+                // The other buffer is free again once the previous step is
+                // done
+                pool.wait();
+                pool.run(d);
+                next = 1 - next;
+                steps++;
+            }
+            pool.wait();
+        }
+
+        segments.Close();
+        for (size_t m = 0; m < modules.size(); m++)
+        {
+            modules[m]->close();
+            MPI_Comm_free(&module_comms[m]);
+        }
+    }
+
+    // Slowest rank of every timing
+    const double total_time = seconds_since(start_total);
+    std::vector<double> times;
+    times.push_back(total_time);
+    times.push_back(read_time);
+    for (const auto &m : modules)
+    {
+        times.push_back(m->compute_time);
+        times.push_back(m->write_time);
+    }
+    std::vector<double> max_times(times.size());
+    MPI_Reduce(times.data(), max_times.data(), static_cast<int>(times.size()),
+               MPI_DOUBLE, MPI_MAX, 0, comm);
+    unsigned long long bytes = read_bytes, total_bytes = 0;
+    MPI_Reduce(&bytes, &total_bytes, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0,
+               comm);
+
+    if (!rank)
+    {
+        const double read_mb = total_bytes / (1024.0 * 1024.0);
+        std::cout << "\n=== Analysis Host Summary ===" << std::endl;
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << "Total execution time:     " << max_times[0] << " seconds"
+                  << std::endl;
+        std::cout << "I/O read time:            " << max_times[1] << " seconds"
+                  << std::endl;
+        std::cout << "Total steps processed:    " << steps << std::endl;
+        std::cout << "Data read (MB):           " << read_mb
+                  << " (once for " << modules.size() << " modules)"
+                  << std::endl;
+        std::cout << "Processes used:           " << comm_size << std::endl;
+        std::cout << "Modules run:              "
+                  << (threaded ? "concurrently" : "one after the other")
+                  << std::endl;
+        if (max_times[1] > 0.0)
+        {
+            std::cout << "Read throughput:          " << read_mb / max_times[1]
+                      << " MB/s" << std::endl;
+        }
+        for (size_t m = 0; m < modules.size(); m++)
+        {
+            std::cout << "Module " << modules[m]->name << " ("
+                      << modules[m]->output << "): compute "
+                      << max_times[2 + 2 * m] << " s, write "
+                      << max_times[3 + 2 * m] << " s" << std::endl;
+        }
+        std::cout << "=============================\n" << std::endl;
+    }
+
+    MPI_Finalize();
+    return 0;
+}
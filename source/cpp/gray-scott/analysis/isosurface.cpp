@@ -1,173 +1,107 @@
 /*
  * Analysis code for the Gray-Scott simulation.
  * Reads variable U and and extracts the iso-surface using VTK.
+ * Only the blocks whose values reach an isovalue are read, by the min/max
+ * of every block in the metadata.
  * Writes the extracted iso-surface using ADIOS.
  *
  * Keichi Takahashi <keichi@is.naist.jp>
  *
  */
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
 #include <adios2.h>
 
 #include <vtkAppendPolyData.h>
-#include <vtkImageData.h>
-#include <vtkImageImport.h>
-#include <vtkMarchingCubes.h>
-#include <vtkPointData.h>
-#include <vtkPolyData.h>
-#include <vtkSmartPointer.h>
-#include <vtkXMLPolyDataWriter.h>
 
+#include "../../../common/block-decomp.hpp"
+#include "../../gray-scott/analysis/isosurface.hpp"
+#include "../../gray-scott/common/segments.hpp"
 #include "../../gray-scott/common/timer.hpp"
 
-vtkSmartPointer<vtkPolyData>
-compute_isosurface(const adios2::Variable<double> &varField,
-                   const std::vector<double> &field, double isovalue)
+// A block of U written by the simulation, grown by the layer of overlap
+// with the blocks after it that marching cubes needs, and the isovalues
+// found in it
+struct Piece
 {
-    // Convert field values to vtkImageData
-    auto importer = vtkSmartPointer<vtkImageImport>::New();
-    importer->SetDataSpacing(1, 1, 1);
-    importer->SetDataOrigin(varField.Start()[2], varField.Start()[1],
-                            varField.Start()[0]);
-    importer->SetWholeExtent(0, varField.Count()[2] - 1, 0,
-                             varField.Count()[1] - 1, 0,
-                             varField.Count()[0] - 1);
-    importer->SetDataExtentToWholeExtent();
-    importer->SetDataScalarTypeToDouble();
-    importer->SetNumberOfScalarComponents(1);
-    importer->SetImportVoidPointer(const_cast<double *>(field.data()));
-
-    // Run the marching cubes algorithm
-    auto mcubes = vtkSmartPointer<vtkMarchingCubes>::New();
-    mcubes->SetInputConnection(importer->GetOutputPort());
-    mcubes->ComputeNormalsOn();
-    mcubes->SetValue(0, isovalue);
-    mcubes->Update();
-
-    // Return the isosurface as vtkPolyData
-    return mcubes->GetOutput();
-}
-
-void write_vtk(const std::string &fname,
-               const vtkSmartPointer<vtkPolyData> polyData)
-{
-    auto writer = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
-    writer->SetFileName(fname.c_str());
-    writer->SetInputData(polyData);
-    writer->Write();
-}
+    decomp::Block block;
+    std::vector<double> isovalues;
+    std::vector<double> u;
+};
 
-void write_adios(adios2::Engine &writer,
-                 const vtkSmartPointer<vtkPolyData> polyData,
-                 adios2::Variable<double> &varPoint,
-                 adios2::Variable<int> &varCell,
-                 adios2::Variable<double> &varNormal,
-                 adios2::Variable<int> &varOutStep, int step, MPI_Comm comm)
+static bool overlap(const decomp::Block &a, const adios2::Dims &start,
+                    const adios2::Dims &count)
 {
-    int numCells = polyData->GetNumberOfPolys();
-    int numPoints = polyData->GetNumberOfPoints();
-    int rank;
-
-    MPI_Comm_rank(comm, &rank);
-
-    std::vector<double> points(numPoints * 3);
-    std::vector<double> normals(numPoints * 3);
-    std::vector<int> cells(numCells * 3); // Assumes that cells are triangles
-
-    double coords[3];
-
-    auto cellArray = polyData->GetPolys();
-
-    cellArray->InitTraversal();
-
-    // Iterate through cells
-    for (int i = 0; i < polyData->GetNumberOfPolys(); i++)
+    for (size_t d = 0; d < start.size(); ++d)
     {
-        auto idList = vtkSmartPointer<vtkIdList>::New();
-
-        cellArray->GetNextCell(idList);
-
-        // Iterate through points of a cell
-        for (int j = 0; j < idList->GetNumberOfIds(); j++)
+        if (a.start[d] >= start[d] + count[d] ||
+            start[d] >= a.start[d] + a.count[d])
         {
-            auto id = idList->GetId(j);
-
-            cells[i * 3 + j] = id;
-
-            polyData->GetPoint(id, coords);
-
-            points[id * 3 + 0] = coords[0];
-            points[id * 3 + 1] = coords[1];
-            points[id * 3 + 2] = coords[2];
+            return false;
         }
     }
+    return true;
+}
 
-    auto normalArray = polyData->GetPointData()->GetNormals();
-
-    // Extract normals
-    for (int i = 0; i < normalArray->GetNumberOfTuples(); i++)
-    {
-        normalArray->GetTuple(i, coords);
-
-        normals[i * 3 + 0] = coords[0];
-        normals[i * 3 + 1] = coords[1];
-        normals[i * 3 + 2] = coords[2];
-    }
-
-    int totalPoints, offsetPoints;
-    MPI_Allreduce(&numPoints, &totalPoints, 1, MPI_INT, MPI_SUM, comm);
-    MPI_Scan(&numPoints, &offsetPoints, 1, MPI_INT, MPI_SUM, comm);
-
-    writer.BeginStep();
-
-    varPoint.SetShape({static_cast<size_t>(totalPoints),
-                       static_cast<size_t>(totalPoints > 0 ? 3 : 0)});
-    varPoint.SetSelection({{static_cast<size_t>(offsetPoints - numPoints), 0},
-                           {static_cast<size_t>(numPoints),
-                            static_cast<size_t>(numPoints > 0 ? 3 : 0)}});
-
-    varNormal.SetShape(varPoint.Shape());
-    varNormal.SetSelection({varPoint.Start(), varPoint.Count()});
-
-    if (numPoints)
-    {
-        writer.Put(varPoint, points.data());
-        writer.Put(varNormal, normals.data());
-    }
-
-    int totalCells, offsetCells;
-    MPI_Allreduce(&numCells, &totalCells, 1, MPI_INT, MPI_SUM, comm);
-    MPI_Scan(&numCells, &offsetCells, 1, MPI_INT, MPI_SUM, comm);
-
-    for (int i = 0; i < cells.size(); i++)
+static size_t cells(const adios2::Dims &count)
+{
+    size_t n = 1;
+    for (const size_t c : count)
     {
-        cells[i] += (offsetPoints - numPoints);
+        n *= c;
     }
+    return n;
+}
 
-    varCell.SetShape({static_cast<size_t>(totalCells),
-                      static_cast<size_t>(totalCells > 0 ? 3 : 0)});
-    varCell.SetSelection({{static_cast<size_t>(offsetCells - numCells), 0},
-                          {static_cast<size_t>(numCells),
-                           static_cast<size_t>(numCells > 0 ? 3 : 0)}});
-
-    if (numCells)
+// The blocks that an isovalue lies within the range of, by the min/max of
+// every block that BP keeps in the metadata. The range of a block includes
+// the blocks its overlap reaches into, a surface between two blocks
+// neither of which reaches the isovalue on its own is found too.
+static std::vector<Piece>
+active_pieces(const std::vector<adios2::Variable<double>::Info> &blocks,
+              const adios2::Dims &shape, const std::vector<double> &isovalues)
+{
+    std::vector<Piece> pieces;
+    for (const auto &b : blocks)
     {
-        writer.Put(varCell, cells.data());
-    }
+        if (!cells(b.Count))
+        {
+            continue;
+        }
+        decomp::Block box;
+        box.start = b.Start;
+        box.count = b.Count;
+        box = decomp::ghost(box, shape, 0, 1);
+
+        double lo = b.Min;
+        double hi = b.Max;
+        for (const auto &o : blocks)
+        {
+            if (cells(o.Count) && overlap(box, o.Start, o.Count))
+            {
+                lo = std::min(lo, o.Min);
+                hi = std::max(hi, o.Max);
+            }
+        }
 
-    if (!rank)
-    {
-        std::cout << "isosurface at step " << step << " writing out "
-                  << totalCells << " cells and " << totalPoints << " points"
-                  << std::endl;
+        Piece piece;
+        piece.block = box;
+        for (const auto isovalue : isovalues)
+        {
+            if (lo <= isovalue && isovalue <= hi)
+            {
+                piece.isovalues.push_back(isovalue);
+            }
+        }
+        if (!piece.isovalues.empty())
+        {
+            pieces.push_back(piece);
+        }
     }
-
-    writer.Put(varOutStep, step);
-
-    writer.EndStep();
+    return pieces;
 }
 
 int main(int argc, char *argv[])
@@ -186,21 +120,6 @@ int main(int argc, char *argv[])
     MPI_Comm_rank(comm, &rank);
     MPI_Comm_size(comm, &procs);
 
-    int dims[3] = {0};
-    MPI_Dims_create(procs, 3, dims);
-    size_t npx = dims[0];
-    size_t npy = dims[1];
-    size_t npz = dims[2];
-
-    int coords[3] = {0};
-    int periods[3] = {0};
-    MPI_Comm cart_comm;
-    MPI_Cart_create(comm, 3, dims, periods, 0, &cart_comm);
-    MPI_Cart_coords(cart_comm, rank, 3, coords);
-    size_t px = coords[0];
-    size_t py = coords[1];
-    size_t pz = coords[2];
-
     if (argc < 4)
     {
         if (rank == 0)
@@ -224,7 +143,8 @@ int main(int argc, char *argv[])
     adios2::ADIOS adios("adios2.xml", comm);
 
     adios2::IO inIO = adios.DeclareIO("SimulationOutput");
-    adios2::Engine reader = inIO.Open(input_fname, adios2::Mode::Read);
+    SegmentedReader segments(inIO, input_fname, comm);
+    adios2::Engine &reader = segments.engine();
 
     adios2::IO outIO = adios.DeclareIO("IsosurfaceOutput");
     adios2::Engine writer = outIO.Open(output_fname, adios2::Mode::Write);
@@ -236,8 +156,10 @@ int main(int argc, char *argv[])
         outIO.DefineVariable<double>("normal", {1, 3}, {0, 0}, {1, 3});
     auto varOutStep = outIO.DefineVariable<int>("step");
 
-    std::vector<double> u;
     int step;
+    // Blocks read and blocks written over all steps, on this rank
+    size_t blocks_read = 0;
+    size_t blocks_total = 0;
 
 #ifdef ENABLE_TIMERS
     Timer timer_total;
@@ -260,48 +182,53 @@ int main(int argc, char *argv[])
         timer_read.start();
 #endif
 
-        adios2::StepStatus status = reader.BeginStep();
+        adios2::StepStatus status = segments.BeginStep();
 
         if (status != adios2::StepStatus::OK)
         {
             break;
         }
 
-        adios2::Variable<double> varU = inIO.InquireVariable<double>("U");
+        adios2::Variable<double> varU = segments.InquireVariable<double>("U");
         const adios2::Variable<int> varStep = inIO.InquireVariable<int>("step");
+        if (!varU)
+        {
+            // No U in this output step
+            reader.EndStep();
+            continue;
+        }
 
         adios2::Dims shape = varU.Shape();
 
-        size_t size_x = (shape[0] + npx - 1) / npx;
-        size_t size_y = (shape[1] + npy - 1) / npy;
-        size_t size_z = (shape[2] + npz - 1) / npz;
+        const std::vector<adios2::Variable<double>::Info> blocks =
+            reader.BlocksInfo(varU, reader.CurrentStep());
+        std::vector<Piece> pieces = active_pieces(blocks, shape, isovalues);
 
-        size_t offset_x = size_x * px;
-        size_t offset_y = size_y * py;
-        size_t offset_z = size_z * pz;
-
-        if (px == npx - 1)
-        {
-            size_x -= size_x * npx - shape[0];
-        }
-        if (py == npy - 1)
+        // Spread the blocks left over the ranks by the cells marched
+        std::vector<double> cost(pieces.size());
+        for (size_t i = 0; i < pieces.size(); ++i)
         {
-            size_y -= size_y * npy - shape[1];
+            cost[i] = static_cast<double>(cells(pieces[i].block.count) *
+                                          pieces[i].isovalues.size());
         }
-        if (pz == npz - 1)
+        const std::vector<size_t> parts = decomp::weighted_1d(cost, procs);
+        std::vector<Piece> mine(pieces.begin() + parts[rank],
+                                pieces.begin() + parts[rank + 1]);
+
+        for (auto &piece : mine)
         {
-            size_z -= size_z * npz - shape[2];
+            varU.SetSelection({piece.block.start, piece.block.count});
+            reader.Get<double>(varU, piece.u);
         }
-
-        varU.SetSelection({{offset_x, offset_y, offset_z},
-                           {size_x + (px != npx - 1 ? 1 : 0),
-                            size_y + (py != npy - 1 ? 1 : 0),
-                            size_z + (pz != npz - 1 ? 1 : 0)}});
-
-        reader.Get<double>(varU, u);
         reader.Get<int>(varStep, step);
         reader.EndStep();
 
+        blocks_read += mine.size();
+        if (!rank)
+        {
+            blocks_total += blocks.size();
+        }
+
 #ifdef ENABLE_TIMERS
         double time_read = timer_read.stop();
         MPI_Barrier(comm);
@@ -309,14 +236,21 @@ int main(int argc, char *argv[])
 #endif
 
         auto appendFilter = vtkSmartPointer<vtkAppendPolyData>::New();
+        auto polyData = vtkSmartPointer<vtkPolyData>::New();
 
-        for (const auto isovalue : isovalues)
+        for (const auto &piece : mine)
         {
-            auto polyData = compute_isosurface(varU, u, isovalue);
-            appendFilter->AddInputData(polyData);
+            for (const auto isovalue : piece.isovalues)
+            {
+                appendFilter->AddInputData(compute_isosurface(
+                    piece.block.start, piece.block.count, piece.u, isovalue));
+            }
+        }
+        if (!mine.empty())
+        {
+            appendFilter->Update();
+            polyData = appendFilter->GetOutput();
         }
-
-        appendFilter->Update();
 
 #ifdef ENABLE_TIMERS
         double time_compute = timer_compute.stop();
@@ -324,8 +258,8 @@ int main(int argc, char *argv[])
         timer_write.start();
 #endif
 
-        write_adios(writer, appendFilter->GetOutput(), varPoint, varCell,
-                    varNormal, varOutStep, step, comm);
+        write_adios(writer, polyData, varPoint, varCell, varNormal,
+                    varOutStep, step, comm);
 
 #ifdef ENABLE_TIMERS
         double time_write = timer_write.stop();
@@ -346,7 +280,16 @@ int main(int argc, char *argv[])
 #endif
 
     writer.Close();
-    reader.Close();
+    segments.Close();
+
+    size_t blocks_read_all = 0;
+    MPI_Reduce(&blocks_read, &blocks_read_all, 1, MPI_UNSIGNED_LONG, MPI_SUM, 0,
+               comm);
+    if (!rank)
+    {
+        std::cout << "Isosurface read " << blocks_read_all << " of "
+                  << blocks_total << " blocks of U" << std::endl;
+    }
 
     MPI_Finalize();
 }
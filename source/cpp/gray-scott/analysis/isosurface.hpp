@@ -0,0 +1,166 @@
+#ifndef __ISOSURFACE_HPP__
+#define __ISOSURFACE_HPP__
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <adios2.h>
+#include <mpi.h>
+
+#include <vtkImageData.h>
+#include <vtkImageImport.h>
+#include <vtkMarchingCubes.h>
+#include <vtkPointData.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkXMLPolyDataWriter.h>
+
+// Marching cubes over the block of field at start with count (z, y, x)
+inline vtkSmartPointer<vtkPolyData>
+compute_isosurface(const adios2::Dims &start, const adios2::Dims &count,
+                   const std::vector<double> &field, double isovalue)
+{
+    // Convert field values to vtkImageData
+    auto importer = vtkSmartPointer<vtkImageImport>::New();
+    importer->SetDataSpacing(1, 1, 1);
+    importer->SetDataOrigin(start[2], start[1], start[0]);
+    importer->SetWholeExtent(0, count[2] - 1, 0, count[1] - 1, 0,
+                             count[0] - 1);
+    importer->SetDataExtentToWholeExtent();
+    importer->SetDataScalarTypeToDouble();
+    importer->SetNumberOfScalarComponents(1);
+    importer->SetImportVoidPointer(const_cast<double *>(field.data()));
+
+    // Run the marching cubes algorithm
+    auto mcubes = vtkSmartPointer<vtkMarchingCubes>::New();
+    mcubes->SetInputConnection(importer->GetOutputPort());
+    mcubes->ComputeNormalsOn();
+    mcubes->SetValue(0, isovalue);
+    mcubes->Update();
+
+    // Return the isosurface as vtkPolyData
+    return mcubes->GetOutput();
+}
+
+inline void write_vtk(const std::string &fname,
+                      const vtkSmartPointer<vtkPolyData> polyData)
+{
+    auto writer = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
+    writer->SetFileName(fname.c_str());
+    writer->SetInputData(polyData);
+    writer->Write();
+}
+
+inline void write_adios(adios2::Engine &writer,
+                        const vtkSmartPointer<vtkPolyData> polyData,
+                        adios2::Variable<double> &varPoint,
+                        adios2::Variable<int> &varCell,
+                        adios2::Variable<double> &varNormal,
+                        adios2::Variable<int> &varOutStep, int step,
+                        MPI_Comm comm)
+{
+    int numCells = polyData->GetNumberOfPolys();
+    int numPoints = polyData->GetNumberOfPoints();
+    int rank;
+
+    MPI_Comm_rank(comm, &rank);
+
+    std::vector<double> points(numPoints * 3);
+    std::vector<double> normals(numPoints * 3);
+    std::vector<int> cells(numCells * 3); // Assumes that cells are triangles
+
+    double coords[3];
+
+    auto cellArray = polyData->GetPolys();
+
+    cellArray->InitTraversal();
+
+    // Iterate through cells
+    for (int i = 0; i < polyData->GetNumberOfPolys(); i++)
+    {
+        auto idList = vtkSmartPointer<vtkIdList>::New();
+
+        cellArray->GetNextCell(idList);
+
+        // Iterate through points of a cell
+        for (int j = 0; j < idList->GetNumberOfIds(); j++)
+        {
+            auto id = idList->GetId(j);
+
+            cells[i * 3 + j] = id;
+
+            polyData->GetPoint(id, coords);
+
+            points[id * 3 + 0] = coords[0];
+            points[id * 3 + 1] = coords[1];
+            points[id * 3 + 2] = coords[2];
+        }
+    }
+
+    auto normalArray = polyData->GetPointData()->GetNormals();
+
+    // Extract normals, there are none without a surface on this rank
+    for (int i = 0; normalArray && i < normalArray->GetNumberOfTuples(); i++)
+    {
+        normalArray->GetTuple(i, coords);
+
+        normals[i * 3 + 0] = coords[0];
+        normals[i * 3 + 1] = coords[1];
+        normals[i * 3 + 2] = coords[2];
+    }
+
+    int totalPoints, offsetPoints;
+    MPI_Allreduce(&numPoints, &totalPoints, 1, MPI_INT, MPI_SUM, comm);
+    MPI_Scan(&numPoints, &offsetPoints, 1, MPI_INT, MPI_SUM, comm);
+
+    writer.BeginStep();
+
+    varPoint.SetShape({static_cast<size_t>(totalPoints),
+                       static_cast<size_t>(totalPoints > 0 ? 3 : 0)});
+    varPoint.SetSelection({{static_cast<size_t>(offsetPoints - numPoints), 0},
+                           {static_cast<size_t>(numPoints),
+                            static_cast<size_t>(numPoints > 0 ? 3 : 0)}});
+
+    varNormal.SetShape(varPoint.Shape());
+    varNormal.SetSelection({varPoint.Start(), varPoint.Count()});
+
+    if (numPoints)
+    {
+        writer.Put(varPoint, points.data());
+        writer.Put(varNormal, normals.data());
+    }
+
+    int totalCells, offsetCells;
+    MPI_Allreduce(&numCells, &totalCells, 1, MPI_INT, MPI_SUM, comm);
+    MPI_Scan(&numCells, &offsetCells, 1, MPI_INT, MPI_SUM, comm);
+
+    for (int i = 0; i < cells.size(); i++)
+    {
+        cells[i] += (offsetPoints - numPoints);
+    }
+
+    varCell.SetShape({static_cast<size_t>(totalCells),
+                      static_cast<size_t>(totalCells > 0 ? 3 : 0)});
+    varCell.SetSelection({{static_cast<size_t>(offsetCells - numCells), 0},
+                          {static_cast<size_t>(numCells),
+                           static_cast<size_t>(numCells > 0 ? 3 : 0)}});
+
+    if (numCells)
+    {
+        writer.Put(varCell, cells.data());
+    }
+
+    if (!rank)
+    {
+        std::cout << "isosurface at step " << step << " writing out "
+                  << totalCells << " cells and " << totalPoints << " points"
+                  << std::endl;
+    }
+
+    writer.Put(varOutStep, step);
+
+    writer.EndStep();
+}
+
+#endif
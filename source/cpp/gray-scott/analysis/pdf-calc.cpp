@@ -21,6 +21,10 @@
 
 #include "adios2.h"
 
+#include "../../../common/block-decomp.hpp"
+#include "../../gray-scott/analysis/pdf.hpp"
+#include "../../gray-scott/common/segments.hpp"
+
 // Performance measurement structure
 struct PerformanceMetrics {
     double total_time = 0.0;
@@ -63,82 +67,6 @@ struct PerformanceMetrics {
     }
 };
 
-bool epsilon(double d) { return (d < 1.0e-20); }
-bool epsilon(float d) { return (d < 1.0e-20); }
-
-/*
- * Function to compute the PDF of a 2D slice
- */
-template <class T>
-void compute_pdf(const std::vector<T> &data,
-                 const std::vector<std::size_t> &shape, const size_t start,
-                 const size_t count, const size_t nbins, const T min,
-                 const T max, std::vector<T> &pdf, std::vector<T> &bins)
-{
-    if (shape.size() != 3)
-        throw std::invalid_argument("ERROR: shape is expected to be 3D\n");
-
-    size_t slice_size = shape[1] * shape[2];
-    pdf.resize(count * nbins);
-    bins.resize(nbins);
-
-    size_t start_data = 0;
-    size_t start_pdf = 0;
-
-    T binWidth = (max - min) / nbins;
-    for (auto i = 0; i < nbins; ++i)
-    {
-        bins[i] = min + (i * binWidth);
-    }
-
-    if (nbins == 1)
-    {
-        // special case: only one bin
-        for (auto i = 0; i < count; ++i)
-        {
-            pdf[i] = slice_size;
-        }
-        return;
-    }
-
-    if (epsilon(max - min) || epsilon(binWidth))
-    {
-        // special case: constant array
-        for (auto i = 0; i < count; ++i)
-        {
-            pdf[i * nbins + (nbins / 2)] = slice_size;
-        }
-        return;
-    }
-
-    for (auto i = 0; i < count; ++i)
-    {
-        // Calculate a PDF for 'nbins' bins for values between 'min' and 'max'
-        // from data[ start_data .. start_data+slice_size-1 ]
-        // into pdf[ start_pdf .. start_pdf+nbins-1 ]
-        for (auto j = 0; j < slice_size; ++j)
-        {
-            if (data[start_data + j] > max || data[start_data + j] < min)
-            {
-                std::cout << " data[" << start * slice_size + start_data + j
-                          << "] = " << data[start_data + j]
-                          << " is out of [min,max] = [" << min << "," << max
-                          << "]" << std::endl;
-            }
-            size_t bin = static_cast<size_t>(
-                std::floor((data[start_data + j] - min) / binWidth));
-            if (bin == nbins)
-            {
-                bin = nbins - 1;
-            }
-            ++pdf[start_pdf + bin];
-        }
-        start_pdf += nbins;
-        start_data += slice_size;
-    }
-    return;
-}
-
 /*
  * Print info to the user on how to invoke the application
  */
@@ -253,8 +181,9 @@ int main(int argc, char *argv[])
         }
 
         // Engines for reading and writing
-        adios2::Engine reader =
-            reader_io.Open(in_filename, adios2::Mode::Read, comm);
+        // The simulation output may be split into segments
+        SegmentedReader segments(reader_io, in_filename, comm);
+        adios2::Engine &reader = segments.engine();
         adios2::Engine writer =
             writer_io.Open(out_filename, adios2::Mode::Write, comm);
 
@@ -273,7 +202,7 @@ int main(int argc, char *argv[])
 
             // Begin step
             adios2::StepStatus read_status =
-                reader.BeginStep(adios2::StepMode::Read, 10.0f);
+                segments.BeginStep(adios2::StepMode::Read, 10.0f);
             if (read_status == adios2::StepStatus::NotReady)
             {
                 // std::cout << "Stream not ready yet. Waiting...\n";
@@ -285,21 +214,28 @@ int main(int argc, char *argv[])
                 break;
             }
 
-            int stepSimOut = reader.CurrentStep();
+            int stepSimOut = segments.CurrentStep();
 
             // Inquire variable and set the selection at the first step only
             // This assumes that the variable dimensions do not change across
             // timesteps
 
-            // Inquire variable
-            var_u_in = reader_io.InquireVariable<double>("U");
-            var_v_in = reader_io.InquireVariable<double>("V");
+            // Inquire variable, U or V may be left out of a step
+            var_u_in = segments.InquireVariable<double>("U");
+            var_v_in = segments.InquireVariable<double>("V");
             var_step_in = reader_io.InquireVariable<int>("step");
+            const bool has_u = static_cast<bool>(var_u_in);
+            const bool has_v = static_cast<bool>(var_v_in);
+            if (!has_u && !has_v)
+            {
+                reader.EndStep();
+                continue;
+            }
+            adios2::Variable<double> &var_in = has_u ? var_u_in : var_v_in;
 
-            std::pair<double, double> minmax_u = var_u_in.MinMax();
-            std::pair<double, double> minmax_v = var_v_in.MinMax();
+            std::pair<double, double> minmax_u, minmax_v;
 
-            shape = var_u_in.Shape();
+            shape = var_in.Shape();
 
             // Calculate global and local sizes of U and V
             u_global_size = shape[0] * shape[1] * shape[2];
@@ -307,13 +243,17 @@ int main(int argc, char *argv[])
             v_global_size = shape[0] * shape[1] * shape[2];
             v_local_size = v_global_size / comm_size;
 
-            size_t count1 = shape[0] / comm_size;
-            size_t start1 = count1 * rank;
-            if (rank == comm_size - 1)
+            // Split the slices along the slowest dimension so that every
+            // process reads whole blocks written by the simulation
+            std::vector<size_t> starts;
+            for (const auto &info :
+                 reader.BlocksInfo(var_in, reader.CurrentStep()))
             {
-                // last process need to read all the rest of slices
-                count1 = shape[0] - count1 * (comm_size - 1);
+                starts.push_back(info.Start[0]);
             }
+            size_t start1, count1;
+            decomp::aligned_1d(decomp::bounds(shape[0], starts), comm_size,
+                               rank, start1, count1);
 
             /*std::cout << "  rank " << rank << " slice start={" <<  start1
               << ",0,0} count={" << count1  << "," << shape[1] << "," <<
@@ -321,10 +261,16 @@ int main(int argc, char *argv[])
               << "}" << std::endl;*/
 
             // Set selection
-            var_u_in.SetSelection(adios2::Box<adios2::Dims>(
-                {start1, 0, 0}, {count1, shape[1], shape[2]}));
-            var_v_in.SetSelection(adios2::Box<adios2::Dims>(
-                {start1, 0, 0}, {count1, shape[1], shape[2]}));
+            const adios2::Box<adios2::Dims> selection(
+                {start1, 0, 0}, {count1, shape[1], shape[2]});
+            if (has_u)
+            {
+                var_u_in.SetSelection(selection);
+            }
+            if (has_v)
+            {
+                var_v_in.SetSelection(selection);
+            }
 
             // Declare variables to output
             if (firstStep)
@@ -356,8 +302,16 @@ int main(int argc, char *argv[])
             }
 
             // Read adios2 data
-            reader.Get<double>(var_u_in, u);
-            reader.Get<double>(var_v_in, v);
+            u.clear();
+            v.clear();
+            if (has_u)
+            {
+                reader.Get<double>(var_u_in, u);
+            }
+            if (has_v)
+            {
+                reader.Get<double>(var_v_in, v);
+            }
             if (shouldIWrite)
             {
                 reader.Get<int>(var_step_in, &simStep);
@@ -388,9 +342,13 @@ int main(int argc, char *argv[])
 
             // HDF5 engine does not provide min/max. Let's calculate it
             //        if (reader_io.EngineType() == "HDF5")
+            if (!u.empty())
             {
                 auto mmu = std::minmax_element(u.begin(), u.end());
                 minmax_u = std::make_pair(*mmu.first, *mmu.second);
+            }
+            if (!v.empty())
+            {
                 auto mmv = std::minmax_element(v.begin(), v.end());
                 minmax_v = std::make_pair(*mmv.first, *mmv.second);
             }
@@ -401,13 +359,19 @@ int main(int argc, char *argv[])
             // Compute PDF
             std::vector<double> pdf_u;
             std::vector<double> bins_u;
-            compute_pdf(u, shape, start1, count1, nbins, minmax_u.first,
-                        minmax_u.second, pdf_u, bins_u);
+            if (has_u)
+            {
+                compute_pdf(u, shape, start1, count1, nbins, minmax_u.first,
+                            minmax_u.second, pdf_u, bins_u);
+            }
 
             std::vector<double> pdf_v;
             std::vector<double> bins_v;
-            compute_pdf(v, shape, start1, count1, nbins, minmax_v.first,
-                        minmax_v.second, pdf_v, bins_v);
+            if (has_v)
+            {
+                compute_pdf(v, shape, start1, count1, nbins, minmax_v.first,
+                            minmax_v.second, pdf_v, bins_v);
+            }
             
             // End computation timing
             auto end_compute = std::chrono::high_resolution_clock::now();
@@ -419,19 +383,38 @@ int main(int argc, char *argv[])
             auto start_write = std::chrono::high_resolution_clock::now();
 
             // write U, V, and their norms out
+            // The PDFs of the variables of this step only
             writer.BeginStep();
-            writer.Put<double>(var_u_pdf, pdf_u.data());
-            writer.Put<double>(var_v_pdf, pdf_v.data());
+            if (has_u)
+            {
+                writer.Put<double>(var_u_pdf, pdf_u.data());
+            }
+            if (has_v)
+            {
+                writer.Put<double>(var_v_pdf, pdf_v.data());
+            }
             if (shouldIWrite)
             {
-                writer.Put<double>(var_u_bins, bins_u.data());
-                writer.Put<double>(var_v_bins, bins_v.data());
+                if (has_u)
+                {
+                    writer.Put<double>(var_u_bins, bins_u.data());
+                }
+                if (has_v)
+                {
+                    writer.Put<double>(var_v_bins, bins_v.data());
+                }
                 writer.Put<int>(var_step_out, simStep);
             }
             if (write_inputvars)
             {
-                writer.Put<double>(var_u_out, u.data());
-                writer.Put<double>(var_v_out, v.data());
+                if (has_u)
+                {
+                    writer.Put<double>(var_u_out, u.data());
+                }
+                if (has_v)
+                {
+                    writer.Put<double>(var_v_out, v.data());
+                }
             }
             writer.EndStep();
             
@@ -457,7 +440,7 @@ int main(int argc, char *argv[])
         }
 
         // cleanup
-        reader.Close();
+        segments.Close();
         writer.Close();
     }
 
@@ -0,0 +1,48 @@
+#!/bin/bash
+
+# Settings file shared by the benchmark scripts, sourced by them. Writes a
+# run of L^3 cells for steps steps with output every plotgap steps into
+# output, and no checkpoint. Every further argument is one more
+# "key": value entry, the setting the benchmark varies.
+#
+# Usage: write_settings file L steps plotgap output [entry ...]
+
+write_settings() {
+    local file=$1
+    local L=$2
+    local steps=$3
+    local plotgap=$4
+    local output=$5
+    shift 5
+    local dir
+    dir=$(dirname "$output")
+    {
+        cat <<EOF
+{
+    "L": $L,
+    "Du": 0.2,
+    "Dv": 0.1,
+    "F": 0.01,
+    "k": 0.05,
+    "dt": 2.0,
+    "plotgap": $plotgap,
+    "steps": $steps,
+    "noise": 0.0000001,
+    "output": "$output",
+    "checkpoint": false,
+    "checkpoint_freq": $steps,
+    "checkpoint_output": "$dir/ckpt.bp",
+    "restart": false,
+    "restart_input": "$dir/ckpt.bp",
+    "adios_config": "adios2.xml",
+    "adios_span": false,
+    "adios_memory_selection": false,
+EOF
+        printf '    "mesh_type": "image"'
+        local entry
+        for entry in "$@"; do
+            printf ',\n    %s' "$entry"
+        done
+        printf '\n}\n'
+    } > "$file"
+}
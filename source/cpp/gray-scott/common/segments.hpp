@@ -0,0 +1,187 @@
+#ifndef __SEGMENTS_HPP__
+#define __SEGMENTS_HPP__
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <adios2.h>
+#include <mpi.h>
+
+// Reads the output of a simulation that may be split into segments by
+// output_rollover_steps or output_rollover_gb. If name.index exists, the
+// segments it lists are read one after the other as if they were one
+// stream, waiting for new ones until the index ends. Otherwise name is read
+// as it is.
+//
+// engine() is the engine of the current segment, for Get and EndStep. It
+// is replaced when a segment ends, so the reference stays valid.
+class SegmentedReader
+{
+public:
+    SegmentedReader(adios2::IO io, const std::string &name, MPI_Comm comm)
+    : io(io), name(name), comm(comm)
+    {
+        MPI_Comm_rank(comm, &rank);
+        int indexed = 0;
+        if (!rank)
+        {
+            indexed = std::ifstream(name + ".index").good();
+        }
+        MPI_Bcast(&indexed, 1, MPI_INT, 0, comm);
+        segmented = indexed != 0;
+        if (!segmented)
+        {
+            reader = io.Open(name, adios2::Mode::Read, comm);
+        }
+
+        // Segment names in the index are relative to its directory
+        const size_t slash = name.rfind('/');
+        if (slash != std::string::npos)
+        {
+            dir = name.substr(0, slash + 1);
+        }
+    }
+
+    adios2::Engine &engine() { return reader; }
+
+    // Engine::BeginStep over all segments. A negative timeout waits for
+    // segments that are not listed yet, otherwise NotReady is returned.
+    adios2::StepStatus BeginStep(adios2::StepMode mode = adios2::StepMode::Read,
+                                 float timeout = -1.0f)
+    {
+        while (true)
+        {
+            if (segmented && !open)
+            {
+                const adios2::StepStatus status = open_next();
+                if (status == adios2::StepStatus::NotReady && timeout < 0.0f)
+                {
+                    std::this_thread::sleep_for(std::chrono::seconds(1));
+                    continue;
+                }
+                if (status != adios2::StepStatus::OK)
+                {
+                    return status;
+                }
+            }
+
+            // A segment cut by a restart ends after its listed steps
+            const adios2::StepStatus status =
+                segmented && limit && segment_step == limit
+                    ? adios2::StepStatus::EndOfStream
+                    : reader.BeginStep(mode, timeout);
+            if (status == adios2::StepStatus::OK)
+            {
+                current = steps_before + segment_step++;
+            }
+            if (!segmented || status != adios2::StepStatus::EndOfStream)
+            {
+                return status;
+            }
+
+            // On to the next segment
+            reader.Close();
+            steps_before += segment_step;
+            segment_step = 0;
+            open = false;
+            next++;
+        }
+    }
+
+    // Variable name of the current step, or a false one if this step does
+    // not have it. The simulation leaves U or V out of some output steps
+    // with output_u_every or output_v_every.
+    template <class T>
+    adios2::Variable<T> InquireVariable(const std::string &name)
+    {
+        adios2::Variable<T> var = io.InquireVariable<T>(name);
+        if (var && reader.BlocksInfo(var, reader.CurrentStep()).empty())
+        {
+            return adios2::Variable<T>();
+        }
+        return var;
+    }
+
+    // Step number counted over all segments
+    size_t CurrentStep() const
+    {
+        return segmented ? current : reader.CurrentStep();
+    }
+
+    void Close()
+    {
+        if (!segmented || open)
+        {
+            reader.Close();
+        }
+    }
+
+private:
+    adios2::IO io;
+    std::string name;
+    std::string dir;
+    MPI_Comm comm;
+    int rank;
+    adios2::Engine reader;
+    bool segmented = false;
+    bool open = false;
+    // Index line of the next segment, and steps read before the current one
+    size_t next = 0;
+    size_t steps_before = 0;
+    size_t segment_step = 0;
+    size_t current = 0;
+    // Output steps to read from the current segment, 0 for all of them
+    size_t limit = 0;
+
+    // Open the segment of index line next if it is listed yet
+    adios2::StepStatus open_next()
+    {
+        // Rank 0 reads the index, the line (or "end", or nothing) goes to
+        // everyone
+        std::string line;
+        if (!rank)
+        {
+            std::ifstream index(name + ".index");
+            for (size_t i = 0; i <= next && std::getline(index, line); i++)
+            {
+            }
+            if (!index)
+            {
+                line.clear();
+            }
+        }
+        int length = static_cast<int>(line.size());
+        MPI_Bcast(&length, 1, MPI_INT, 0, comm);
+        line.resize(length);
+        MPI_Bcast(&line[0], length, MPI_CHAR, 0, comm);
+
+        if (line.empty())
+        {
+            return adios2::StepStatus::NotReady;
+        }
+        if (line == "end")
+        {
+            return adios2::StepStatus::EndOfStream;
+        }
+
+        // first_step last_step file [output steps]
+        std::istringstream entry(line);
+        int first, last;
+        std::string file;
+        entry >> first >> last >> file;
+        if (!(entry >> limit))
+        {
+            limit = 0;
+        }
+        io.RemoveAllVariables();
+        reader = io.Open(dir + file, adios2::Mode::Read, comm);
+        open = true;
+        return adios2::StepStatus::OK;
+    }
+};
+
+#endif
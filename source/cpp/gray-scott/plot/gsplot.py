@@ -108,6 +108,9 @@ if __name__ == "__main__":
     # Read through the steps, one at a time
     plot_step = 0
     for fr_step in fr:
+        # The simulation may leave the variable out of some steps
+        if args.varname not in fr_step.available_variables():
+            continue
 #        if fr_step.current_step()
         start, size, fullshape = mpi.Partition_3D_3D(fr, args)
         cur_step= fr_step.current_step()
@@ -85,6 +85,9 @@ if __name__ == "__main__":
         # print (vars_info)
         pdfvar = args.varname+"/pdf"
         binvar = args.varname+"/bins"
+        # The analysis has no PDF for steps without the variable
+        if pdfvar not in vars_info:
+            continue
         shape2_str = vars_info[pdfvar]["Shape"].split(',')
         shape2 = list(map(int,shape2_str))
 
@@ -0,0 +1,153 @@
+#include "../../gray-scott/simulation/forward.h"
+
+#include <stdexcept>
+
+bool split_io_ranks(const Settings &settings, MPI_Comm comm, MPI_Comm &part,
+                    int &server, std::vector<int> &clients)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    MPI_Comm node;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL,
+                        &node);
+    int node_rank, node_size;
+    MPI_Comm_rank(node, &node_rank);
+    MPI_Comm_size(node, &node_size);
+
+    const int K = settings.io_ranks_per_node;
+    if (node_size <= K)
+    {
+        throw std::invalid_argument(
+            "ERROR: io_ranks_per_node leaves no compute ranks on a node of " +
+            std::to_string(node_size) + " processes\n");
+    }
+
+    // Ranks in comm of everyone on this node
+    std::vector<int> node_ranks(node_size);
+    MPI_Allgather(&rank, 1, MPI_INT, node_ranks.data(), 1, MPI_INT, node);
+    MPI_Comm_free(&node);
+
+    // Compute rank c of the node sends to I/O rank c % K of the node
+    const int first_io = node_size - K;
+    const bool is_io = node_rank >= first_io;
+    server = -1;
+    clients.clear();
+    if (is_io)
+    {
+        for (int c = node_rank - first_io; c < first_io; c += K)
+        {
+            clients.push_back(node_ranks[c]);
+        }
+    }
+    else
+    {
+        server = node_ranks[first_io + node_rank % K];
+    }
+
+    MPI_Comm_split(comm, is_io ? 1 : 0, rank, &part);
+    return is_io;
+}
+
+ForwardClient::ForwardClient(MPI_Comm comm, int server)
+: comm(comm), server(server)
+{
+    requests[0] = MPI_REQUEST_NULL;
+    requests[1] = MPI_REQUEST_NULL;
+}
+
+void ForwardClient::write(int step, const GrayScott &sim)
+{
+    MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+
+    // The box goes with every step, it moves when the simulation rebalances
+    const size_t n = sim.size_x * sim.size_y * sim.size_z;
+    header[0] = step;
+    header[1] = sim.offset_z;
+    header[2] = sim.offset_y;
+    header[3] = sim.offset_x;
+    header[4] = sim.size_z;
+    header[5] = sim.size_y;
+    header[6] = sim.size_x;
+
+    buffer.resize(2 * n);
+    sim.u_noghost(buffer.data());
+    sim.v_noghost(buffer.data() + n);
+
+    MPI_Isend(header, 7, MPI_LONG_LONG, server, 1, comm, &requests[0]);
+    MPI_Isend(buffer.data(), static_cast<int>(2 * n), MPI_DOUBLE, server, 2,
+              comm, &requests[1]);
+}
+
+void ForwardClient::close()
+{
+    MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+    header[0] = -1;
+    MPI_Send(header, 7, MPI_LONG_LONG, server, 1, comm);
+}
+
+ForwardServer::ForwardServer(const Settings &settings, MPI_Comm comm,
+                             MPI_Comm io_comm, const std::vector<int> &clients,
+                             adios2::IO io)
+: comm(comm), io_comm(io_comm), clients(clients), writer(settings, io)
+{
+}
+
+void ForwardServer::run(const std::string &fname, int restart_step)
+{
+    writer.open(fname, restart_step, io_comm);
+
+    std::vector<Writer::Block> blocks(clients.size());
+    std::vector<bool> open(clients.size(), true);
+    while (true)
+    {
+        // The compute ranks output the same steps, so every open client
+        // sends either a block of the next step or its close. Clients are
+        // received in order, a fast one may already have sent the step
+        // after.
+        int step = 0;
+        size_t received = 0;
+        for (size_t c = 0; c < clients.size(); c++)
+        {
+            if (!open[c])
+            {
+                continue;
+            }
+            long long header[7];
+            MPI_Recv(header, 7, MPI_LONG_LONG, clients[c], 1, comm,
+                     MPI_STATUS_IGNORE);
+            if (header[0] < 0)
+            {
+                open[c] = false;
+                continue;
+            }
+
+            Writer::Block &b = blocks[received++];
+            step = static_cast<int>(header[0]);
+            b.offset_z = header[1];
+            b.offset_y = header[2];
+            b.offset_x = header[3];
+            b.size_z = header[4];
+            b.size_y = header[5];
+            b.size_x = header[6];
+            b.data.resize(2 * b.size_x * b.size_y * b.size_z);
+            MPI_Recv(b.data.data(), static_cast<int>(b.data.size()),
+                     MPI_DOUBLE, clients[c], 2, comm,
+                     MPI_STATUS_IGNORE);
+        }
+
+        // I/O ranks without clients follow the others
+        int more = received > 0;
+        MPI_Allreduce(MPI_IN_PLACE, &more, 1, MPI_INT, MPI_MAX, io_comm);
+        if (!more)
+        {
+            break;
+        }
+
+        // and name the output segment by the step of the others
+        MPI_Allreduce(MPI_IN_PLACE, &step, 1, MPI_INT, MPI_MAX, io_comm);
+        writer.write(step, blocks.data(), received);
+    }
+
+    writer.close();
+}
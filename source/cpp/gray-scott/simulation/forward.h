@@ -0,0 +1,69 @@
+#ifndef __FORWARD_H__
+#define __FORWARD_H__
+
+#include <string>
+#include <vector>
+
+#include <adios2.h>
+#include <mpi.h>
+
+#include "../../gray-scott/simulation/gray-scott.h"
+#include "../../gray-scott/simulation/settings.h"
+#include "../../gray-scott/simulation/writer.h"
+
+// Output through dedicated I/O ranks. settings.io_ranks_per_node ranks of
+// every node are taken out of the simulation. The compute ranks of a node
+// hand their interior U and V to one of these with nonblocking sends and go
+// on with the next step, while the I/O ranks own the ADIOS2 engine and do
+// the writing.
+
+// Split comm into compute ranks and I/O ranks, the last
+// settings.io_ranks_per_node ranks of every node. part receives the ranks of
+// the same kind as this one. On compute ranks server is the rank in comm of
+// the I/O rank to send to, on I/O ranks clients are the ranks in comm of the
+// compute ranks sending to it. Returns true on I/O ranks.
+bool split_io_ranks(const Settings &settings, MPI_Comm comm, MPI_Comm &part,
+                    int &server, std::vector<int> &clients);
+
+// Compute rank side
+class ForwardClient
+{
+public:
+    ForwardClient(MPI_Comm comm, int server);
+
+    // Send the interior of sim to the server. Only waits for the previous
+    // step to be sent, as its buffer is reused.
+    void write(int step, const GrayScott &sim);
+    // Tell the server that no more steps follow
+    void close();
+
+protected:
+    MPI_Comm comm;
+    int server;
+    // step, offset z, y, x, size z, y, x
+    long long header[7];
+    // u then v without ghosts
+    std::vector<double> buffer;
+    MPI_Request requests[2];
+};
+
+// I/O rank side
+class ForwardServer
+{
+public:
+    // comm is the communicator of split_io_ranks, io_comm the I/O ranks
+    ForwardServer(const Settings &settings, MPI_Comm comm, MPI_Comm io_comm,
+                  const std::vector<int> &clients, adios2::IO io);
+
+    // Write every step received from the clients to fname until all of them
+    // closed
+    void run(const std::string &fname, int restart_step);
+
+protected:
+    MPI_Comm comm;
+    MPI_Comm io_comm;
+    std::vector<int> clients;
+    Writer writer;
+};
+
+#endif
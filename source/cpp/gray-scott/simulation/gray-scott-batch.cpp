@@ -0,0 +1,244 @@
+#include "../../gray-scott/simulation/gray-scott-batch.h"
+
+#include "../../../common/block-decomp.hpp"
+
+#include <algorithm>
+#include <mpi.h>
+#include <vector>
+
+GrayScottBatch::GrayScottBatch(const Settings &settings, MPI_Comm comm,
+                               int first_member, int members)
+: settings(settings), member0(first_member), W(members), comm(comm)
+{
+    for (int m = 0; m < W; m++)
+    {
+        const Settings s = settings.for_member(member0 + m);
+        F.push_back(s.F);
+        Fk.push_back(s.F + s.k);
+    }
+}
+
+GrayScottBatch::~GrayScottBatch() {}
+
+void GrayScottBatch::init()
+{
+    init_mpi();
+    init_field();
+}
+
+void GrayScottBatch::iterate()
+{
+    exchange(u);
+    exchange(v);
+    calc(u, v, u2, v2);
+
+    u.swap(u2);
+    v.swap(v2);
+}
+
+void GrayScottBatch::u_noghost(double *u_no_ghost) const
+{
+    data_noghost(u, u_no_ghost);
+}
+
+void GrayScottBatch::v_noghost(double *v_no_ghost) const
+{
+    data_noghost(v, v_no_ghost);
+}
+
+void GrayScottBatch::init_mpi()
+{
+    int dims[3] = {};
+    const int periods[3] = {1, 1, 1};
+    int coords[3] = {};
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &procs);
+
+    MPI_Dims_create(procs, 3, dims);
+    npx = dims[0];
+    npy = dims[1];
+    npz = dims[2];
+
+    MPI_Cart_create(comm, 3, dims, periods, 0, &cart_comm);
+    MPI_Cart_coords(cart_comm, rank, 3, coords);
+    px = coords[0];
+    py = coords[1];
+    pz = coords[2];
+
+    const decomp::Block b =
+        decomp::block({settings.L, settings.L, settings.L},
+                      {npx, npy, npz}, {px, py, pz});
+    offset_x = b.start[0];
+    offset_y = b.start[1];
+    offset_z = b.start[2];
+    size_x = b.count[0];
+    size_y = b.count[1];
+    size_z = b.count[2];
+
+    MPI_Cart_shift(cart_comm, 0, 1, &west, &east);
+    MPI_Cart_shift(cart_comm, 1, 1, &down, &up);
+    MPI_Cart_shift(cart_comm, 2, 1, &south, &north);
+
+    // The faces are those of GrayScott, with a cell of W values as element
+    MPI_Type_contiguous(W, MPI_DOUBLE, &cell_type);
+    MPI_Type_commit(&cell_type);
+
+    // XY faces: size_x * (size_y + 2)
+    MPI_Type_vector(size_y + 2, size_x, size_x + 2, cell_type, &xy_face_type);
+    MPI_Type_commit(&xy_face_type);
+
+    // XZ faces: size_x * size_z
+    MPI_Type_vector(size_z, size_x, (size_x + 2) * (size_y + 2), cell_type,
+                    &xz_face_type);
+    MPI_Type_commit(&xz_face_type);
+
+    // YZ faces: (size_y + 2) * (size_z + 2)
+    MPI_Type_vector((size_y + 2) * (size_z + 2), 1, size_x + 2, cell_type,
+                    &yz_face_type);
+    MPI_Type_commit(&yz_face_type);
+}
+
+void GrayScottBatch::init_field()
+{
+    const size_t V = (size_x + 2) * (size_y + 2) * (size_z + 2) * W;
+
+    u2.resize(V);
+    v2.resize(V);
+    u.resize(V);
+    v.resize(V);
+    for (size_t i = 0; i < V; i++)
+    {
+        u[i] = 1.0;
+        v[i] = 0.0;
+    }
+
+    // Same seed cube as GrayScott, in every member
+    const int d = 6;
+    const int lo = static_cast<int>(settings.L / 2) - d;
+    const int hi = static_cast<int>(settings.L / 2) + d;
+
+    const int x0 = std::max(lo, static_cast<int>(offset_x));
+    const int x1 = std::min(hi, static_cast<int>(offset_x + size_x));
+    const int y0 = std::max(lo, static_cast<int>(offset_y));
+    const int y1 = std::min(hi, static_cast<int>(offset_y + size_y));
+    const int z0 = std::max(lo, static_cast<int>(offset_z));
+    const int z1 = std::min(hi, static_cast<int>(offset_z + size_z));
+
+    for (int z = z0; z < z1; z++)
+    {
+        for (int y = y0; y < y1; y++)
+        {
+            for (int x = x0; x < x1; x++)
+            {
+                const int i = l2i(x - offset_x + 1, y - offset_y + 1,
+                                  z - offset_z + 1) *
+                              W;
+                for (int m = 0; m < W; m++)
+                {
+                    u[i + m] = 0.25;
+                    v[i + m] = 0.33;
+                }
+            }
+        }
+    }
+}
+
+void GrayScottBatch::calc(const Field &u, const Field &v, Field &u2,
+                          Field &v2) const
+{
+    // Neighbor distances in values
+    const int sx = W;
+    const int sy = (size_x + 2) * W;
+    const int sz = (size_x + 2) * (size_y + 2) * W;
+    const double Du = settings.Du;
+    const double Dv = settings.Dv;
+    const double dt = settings.dt;
+    const double *pF = F.data();
+    const double *pFk = Fk.data();
+
+    for (int z = 1; z < size_z + 1; z++)
+    {
+        for (int y = 1; y < size_y + 1; y++)
+        {
+            for (int x = 1; x < size_x + 1; x++)
+            {
+                const int c = l2i(x, y, z) * W;
+                const double *pu = &u[c];
+                const double *pv = &v[c];
+                double *pu2 = &u2[c];
+                double *pv2 = &v2[c];
+
+                // Members are independent and contiguous, this loop is
+                // vectorized across them
+                for (int m = 0; m < W; m++)
+                {
+                    const double tu = pu[m];
+                    const double tv = pv[m];
+                    const double lu = (pu[m - sx] + pu[m + sx] + pu[m - sy] +
+                                       pu[m + sy] + pu[m - sz] + pu[m + sz] +
+                                       -6.0 * tu) /
+                                      6.0;
+                    const double lv = (pv[m - sx] + pv[m + sx] + pv[m - sy] +
+                                       pv[m + sy] + pv[m - sz] + pv[m + sz] +
+                                       -6.0 * tv) /
+                                      6.0;
+                    double du = Du * lu;
+                    double dv = Dv * lv;
+                    du += -tu * tv * tv + pF[m] * (1.0 - tu);
+                    dv += tu * tv * tv - pFk[m] * tv;
+                    pu2[m] = tu + du * dt;
+                    pv2[m] = tv + dv * dt;
+                }
+            }
+        }
+    }
+}
+
+void GrayScottBatch::exchange(Field &data) const
+{
+    MPI_Status st;
+    auto lf_at = [&](int x, int y, int z) { return &data[l2i(x, y, z) * W]; };
+
+    // XY faces with north/south
+    MPI_Sendrecv(lf_at(1, 0, size_z), 1, xy_face_type, north, 1,
+                 lf_at(1, 0, 0), 1, xy_face_type, south, 1, cart_comm, &st);
+    MPI_Sendrecv(lf_at(1, 0, 1), 1, xy_face_type, south, 1,
+                 lf_at(1, 0, size_z + 1), 1, xy_face_type, north, 1,
+                 cart_comm, &st);
+
+    // XZ faces with up/down
+    MPI_Sendrecv(lf_at(1, size_y, 1), 1, xz_face_type, up, 2, lf_at(1, 0, 1),
+                 1, xz_face_type, down, 2, cart_comm, &st);
+    MPI_Sendrecv(lf_at(1, 1, 1), 1, xz_face_type, down, 2,
+                 lf_at(1, size_y + 1, 1), 1, xz_face_type, up, 2, cart_comm,
+                 &st);
+
+    // YZ faces with west/east
+    MPI_Sendrecv(lf_at(size_x, 0, 0), 1, yz_face_type, east, 3,
+                 lf_at(0, 0, 0), 1, yz_face_type, west, 3, cart_comm, &st);
+    MPI_Sendrecv(lf_at(1, 0, 0), 1, yz_face_type, west, 3,
+                 lf_at(size_x + 1, 0, 0), 1, yz_face_type, east, 3, cart_comm,
+                 &st);
+}
+
+void GrayScottBatch::data_noghost(const Field &data, double *no_ghost) const
+{
+    const size_t n = size_x * size_y * size_z;
+    for (int z = 1; z < size_z + 1; z++)
+    {
+        for (int y = 1; y < size_y + 1; y++)
+        {
+            for (int x = 1; x < size_x + 1; x++)
+            {
+                const size_t j = (x - 1) + (y - 1) * size_x +
+                                 (z - 1) * size_x * size_y;
+                const int i = l2i(x, y, z) * W;
+                for (int m = 0; m < W; m++)
+                {
+                    no_ghost[m * n + j] = data[i + m];
+                }
+            }
+        }
+    }
+}
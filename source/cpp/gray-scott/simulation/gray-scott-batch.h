@@ -0,0 +1,83 @@
+#ifndef __GRAY_SCOTT_BATCH_H__
+#define __GRAY_SCOTT_BATCH_H__
+
+#include <vector>
+
+#include <mpi.h>
+
+#include "../../gray-scott/simulation/gray-scott.h"
+#include "../../gray-scott/simulation/settings.h"
+
+// Advances several ensemble members with different F and k at once, for
+// sweeps over small domains where a single simulation cannot keep a core
+// busy. The members of a cell are stored next to each other, so the stencil
+// for one cell is computed for all members with the same vector instructions
+// and one halo exchange serves all of them.
+//
+// Explicit time stepping only, without active bricks, refinement or
+// rebalancing.
+class GrayScottBatch
+{
+public:
+    // Interleaved ghosted fields, (size_x + 2) * (size_y + 2) * (size_z + 2)
+    // cells of members() values each
+    using Field = GrayScott::Field;
+
+    // Dimension of process grid
+    size_t npx, npy, npz;
+    // Coordinate of this rank in process grid
+    size_t px, py, pz;
+    // Dimension of local array
+    size_t size_x, size_y, size_z;
+    // Offset of local array in the global array
+    size_t offset_x, offset_y, offset_z;
+
+    // Members first_member, first_member + 1, ... of settings.ensemble_F/k
+    GrayScottBatch(const Settings &settings, MPI_Comm comm, int first_member,
+                   int members);
+    ~GrayScottBatch();
+
+    void init();
+    void iterate();
+
+    int first_member() const { return member0; }
+    int members() const { return W; }
+
+    // Fields without ghosts, member by member: [member][z][y][x]
+    void u_noghost(double *u_no_ghost) const;
+    void v_noghost(double *v_no_ghost) const;
+
+protected:
+    Settings settings;
+    int member0;
+    int W;
+    // Per-member parameters, F + k is precomputed for the V reaction term
+    std::vector<double> F, Fk;
+
+    Field u, v, u2, v2;
+
+    int rank, procs;
+    int west, east, up, down, north, south;
+    MPI_Comm comm;
+    MPI_Comm cart_comm;
+
+    // One cell of all members, and halo exchange types built from it
+    MPI_Datatype cell_type;
+    MPI_Datatype xy_face_type;
+    MPI_Datatype xz_face_type;
+    MPI_Datatype yz_face_type;
+
+    void init_mpi();
+    void init_field();
+    void calc(const Field &u, const Field &v, Field &u2, Field &v2) const;
+    void exchange(Field &data) const;
+    void data_noghost(const Field &data, double *no_ghost) const;
+
+    // Convert local coordinate to local cell index
+    inline int l2i(int x, int y, int z) const
+    {
+        return x + y * (size_x + 2) + z * (size_x + 2) * (size_y + 2);
+    }
+};
+
+#endif
@@ -4,6 +4,12 @@
 
 #include "../../gray-scott/simulation/gray-scott.h"
 
+#include "../../../common/block-decomp.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
 #include <mpi.h>
 #include <random>
 #include <stdexcept> // runtime_error
@@ -11,7 +17,9 @@
 
 GrayScott::GrayScott(const Settings &settings, MPI_Comm comm)
 : settings(settings), comm(comm), rand_dev(), mt_gen(rand_dev()),
-  uniform_dist(-1.0, 1.0)
+  uniform_dist(-1.0, 1.0), sim_time(0.0), dt(settings.dt), cg_iterations(0),
+  fine(settings), regrid_steps(0),
+  compute_time(0.0), window_steps(0)
 {
 }
 
@@ -21,24 +29,214 @@ void GrayScott::init()
 {
     init_mpi();
     init_field();
+    init_bricks();
 }
 
 void GrayScott::iterate()
 {
+    if (settings.integrator == "imex")
+    {
+        iterate_imex();
+        return;
+    }
+
     exchange(u, v);
-    calc(u, v, u2, v2);
 
+    const auto start = std::chrono::steady_clock::now();
+    if (settings.amr && regrid_steps++ % settings.amr_interval == 0)
+    {
+        fine.regrid(u.data(), v.data());
+    }
+    // with noise every cell changes every step, nothing can be skipped
+    if (settings.active_bricks && settings.noise == 0.0)
+    {
+        update_active_bricks();
+        calc_bricks(u, v, u2, v2);
+    }
+    else if (in_place())
+    {
+        calc_in_place(u, v);
+    }
+    else
+    {
+        calc(u, v, u2, v2);
+    }
+    if (settings.amr)
+    {
+        fine.advance(u.data(), v.data(), u2.data(), v2.data());
+        // The refined bricks changed behind the back of the active brick
+        // tracking, compute them in the next step
+        for (size_t b = 0; b < brick_dev.size(); b++)
+        {
+            if (fine.refined(b))
+            {
+                brick_dev[b] = 1;
+                brick_synced[b] = 0;
+            }
+        }
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    compute_time += elapsed.count();
+
+    if (!in_place())
+    {
+        u.swap(u2);
+        v.swap(v2);
+    }
+    sim_time += settings.dt;
+
+    if (settings.rebalance_interval > 0 &&
+        ++window_steps == settings.rebalance_interval)
+    {
+        rebalance();
+    }
+}
+
+void GrayScott::iterate_imex()
+{
+    // With error control, retry with a smaller step until the estimate is
+    // met, then let the next step grow by at most 2x
+    while (true)
+    {
+        const double step_dt = dt;
+        cg_iterations = solve_imex(u, v, u2, v2, step_dt);
+        if (settings.dt_tolerance <= 0.0)
+        {
+            sim_time += step_dt;
+            break;
+        }
+
+        const double err = imex_error(u, v, u2, v2, step_dt);
+        const double factor =
+            0.9 * std::sqrt(settings.dt_tolerance /
+                            std::max(err, std::numeric_limits<double>::min()));
+        if (err > settings.dt_tolerance)
+        {
+            dt *= std::max(factor, 0.2);
+            continue;
+        }
+
+        sim_time += step_dt;
+        dt *= std::min(factor, 2.0);
+        if (settings.dt_max > 0.0)
+        {
+            dt = std::min(dt, settings.dt_max);
+        }
+        break;
+    }
     u.swap(u2);
     v.swap(v2);
 }
 
+int GrayScott::solve_imex(const Field &u, const Field &v, Field &u2,
+                          Field &v2, double dt)
+{
+    const size_t V = u.size();
+    Field *work[] = {&cg_ru, &cg_rv, &cg_pu, &cg_pv, &cg_qu, &cg_qv};
+    for (auto w : work)
+    {
+        w->resize(V);
+    }
+
+    auto lf_sum = [&](double *s, int n) {
+        MPI_Allreduce(MPI_IN_PLACE, s, n, MPI_DOUBLE, MPI_SUM, comm);
+    };
+
+    // Right hand side, which is also the initial guess
+    double bb[2] = {0.0, 0.0};
+    for_each_cell([&](int, int, int, int i) {
+        const double du = calcU(u[i], v[i]) + settings.noise * uniform_dist(mt_gen);
+        const double dv = calcV(u[i], v[i]);
+        u2[i] = u[i] + du * dt;
+        v2[i] = v[i] + dv * dt;
+        bb[0] += u2[i] * u2[i];
+        bb[1] += v2[i] * v2[i];
+    });
+    lf_sum(bb, 2);
+
+    // r = b - A x = dt D lap(x) for x = b
+    const double au = dt * settings.Du;
+    const double av = dt * settings.Dv;
+    exchange(u2, v2);
+    double rho[2] = {0.0, 0.0};
+    for_each_cell([&](int x, int y, int z, int i) {
+        cg_ru[i] = cg_pu[i] = au * laplacian(x, y, z, u2);
+        cg_rv[i] = cg_pv[i] = av * laplacian(x, y, z, v2);
+        rho[0] += cg_ru[i] * cg_ru[i];
+        rho[1] += cg_rv[i] * cg_rv[i];
+    });
+    lf_sum(rho, 2);
+
+    auto lf_div = [](double a, double b) { return b > 0.0 ? a / b : 0.0; };
+    const double tol2 = settings.cg_tolerance * settings.cg_tolerance;
+    int it = 0;
+    for (; it < settings.cg_max_iterations; it++)
+    {
+        if (rho[0] <= tol2 * bb[0] && rho[1] <= tol2 * bb[1])
+        {
+            break;
+        }
+
+        exchange(cg_pu, cg_pv);
+        double pq[2] = {0.0, 0.0};
+        for_each_cell([&](int x, int y, int z, int i) {
+            cg_qu[i] = cg_pu[i] - au * laplacian(x, y, z, cg_pu);
+            cg_qv[i] = cg_pv[i] - av * laplacian(x, y, z, cg_pv);
+            pq[0] += cg_pu[i] * cg_qu[i];
+            pq[1] += cg_pv[i] * cg_qv[i];
+        });
+        lf_sum(pq, 2);
+
+        const double alpha[2] = {lf_div(rho[0], pq[0]), lf_div(rho[1], pq[1])};
+        double rho_next[2] = {0.0, 0.0};
+        for_each_cell([&](int, int, int, int i) {
+            u2[i] += alpha[0] * cg_pu[i];
+            v2[i] += alpha[1] * cg_pv[i];
+            cg_ru[i] -= alpha[0] * cg_qu[i];
+            cg_rv[i] -= alpha[1] * cg_qv[i];
+            rho_next[0] += cg_ru[i] * cg_ru[i];
+            rho_next[1] += cg_rv[i] * cg_rv[i];
+        });
+        lf_sum(rho_next, 2);
+
+        const double beta[2] = {lf_div(rho_next[0], rho[0]),
+                                lf_div(rho_next[1], rho[1])};
+        for_each_cell([&](int, int, int, int i) {
+            cg_pu[i] = cg_ru[i] + beta[0] * cg_pu[i];
+            cg_pv[i] = cg_rv[i] + beta[1] * cg_pv[i];
+        });
+        rho[0] = rho_next[0];
+        rho[1] = rho_next[1];
+    }
+    return it;
+}
+
+double GrayScott::imex_error(const Field &u, const Field &v, const Field &u2,
+                             const Field &v2, double dt) const
+{
+    // Forward Euler on the reaction term is off by about dt / 2 times the
+    // change of the reaction term over the step
+    double err = 0.0;
+    for_each_cell([&](int, int, int, int i) {
+        err = std::max(err,
+                       std::abs(calcU(u2[i], v2[i]) - calcU(u[i], v[i])));
+        err = std::max(err,
+                       std::abs(calcV(u2[i], v2[i]) - calcV(u[i], v[i])));
+    });
+    err *= 0.5 * dt;
+    MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_DOUBLE, MPI_MAX, comm);
+    return err;
+}
+
 void GrayScott::restart(std::vector<double> &u_in, std::vector<double> &v_in)
 {
     auto expected_len = (size_x + 2) * (size_y + 2) * (size_z + 2);
     if (u_in.size() == expected_len)
     {
-        u = u_in;
-        v = v_in;
+        u.assign(u_in.begin(), u_in.end());
+        v.assign(v_in.begin(), v_in.end());
+        init_bricks();
     }
     else
     {
@@ -49,9 +247,40 @@ void GrayScott::restart(std::vector<double> &u_in, std::vector<double> &v_in)
     }
 }
 
-const std::vector<double> &GrayScott::u_ghost() const { return u; }
+void GrayScott::restart_noghost(const std::vector<double> &u_in,
+                                const std::vector<double> &v_in)
+{
+    const size_t expected_len = size_x * size_y * size_z;
+    if (u_in.size() != expected_len || v_in.size() != expected_len)
+    {
+        throw std::runtime_error(
+            "Restart with incompatible array size, expected " +
+            std::to_string(expected_len) + " got " +
+            std::to_string(u_in.size()) + " elements");
+    }
+
+    // init_field() leaves u and v empty on restart. The boundary ghosts
+    // the exchange does not fill keep the steady state.
+    const size_t V = (size_x + 2) * (size_y + 2) * (size_z + 2);
+    u.assign(V, 1.0);
+    v.assign(V, 0.0);
+
+    for (int z = 1; z < size_z + 1; z++)
+    {
+        for (int y = 1; y < size_y + 1; y++)
+        {
+            const size_t j = (y - 1) * size_x + (z - 1) * size_x * size_y;
+            std::copy(&u_in[j], &u_in[j] + size_x, &u[l2i(1, y, z)]);
+            std::copy(&v_in[j], &v_in[j] + size_x, &v[l2i(1, y, z)]);
+        }
+    }
+    exchange(u, v);
+    init_bricks();
+}
+
+const GrayScott::Field &GrayScott::u_ghost() const { return u; }
 
-const std::vector<double> &GrayScott::v_ghost() const { return v; }
+const GrayScott::Field &GrayScott::v_ghost() const { return v; }
 
 std::vector<double> GrayScott::u_noghost() const { return data_noghost(u); }
 
@@ -67,37 +296,74 @@ void GrayScott::v_noghost(double *v_no_ghost) const
     data_noghost(v, v_no_ghost);
 }
 
-std::vector<double>
-GrayScott::data_noghost(const std::vector<double> &data) const
+void GrayScott::u_noghost(double *u_no_ghost,
+                          std::vector<Slice> &slices) const
+{
+    data_noghost(u, u_no_ghost, slices);
+}
+
+void GrayScott::v_noghost(double *v_no_ghost,
+                          std::vector<Slice> &slices) const
+{
+    data_noghost(v, v_no_ghost, slices);
+}
+
+std::vector<double> GrayScott::data_noghost(const Field &data) const
 {
     std::vector<double> buf(size_x * size_y * size_z);
     data_no_ghost_common(data, buf.data());
     return buf;
 }
 
-void GrayScott::data_noghost(const std::vector<double> &data,
-                             double *data_no_ghost) const
+void GrayScott::data_noghost(const Field &data, double *data_no_ghost) const
 {
     data_no_ghost_common(data, data_no_ghost);
 }
 
 void GrayScott::init_field()
 {
-    const int V = (size_x + 2) * (size_y + 2) * (size_z + 2);
-    u.resize(V, 1.0);
-    v.resize(V, 0.0);
-    u2.resize(V, 0.0);
-    v2.resize(V, 0.0);
+    const size_t V = (size_x + 2) * (size_y + 2) * (size_z + 2);
+
+    // u2/v2 are not initialized: calc() writes every interior cell before
+    // it is read and the halo exchange fills the faces, so their first touch
+    // is the first step. Edge and corner ghosts are never read by the
+    // stencil. The in-place update does not use them at all.
+    u2.resize(in_place() ? 0 : V);
+    v2.resize(in_place() ? 0 : V);
 
+    if (settings.restart)
+    {
+        // restart() and restart_noghost() allocate and fill u/v
+        return;
+    }
+
+    u.resize(V);
+    v.resize(V);
+    for (size_t i = 0; i < V; i++)
+    {
+        u[i] = 1.0;
+        v[i] = 0.0;
+    }
+
+    // Seed a cube of side 2 * d at the center of the domain, only the part
+    // intersecting this block is visited
     const int d = 6;
-    for (int z = settings.L / 2 - d; z < settings.L / 2 + d; z++)
+    const int lo = static_cast<int>(settings.L / 2) - d;
+    const int hi = static_cast<int>(settings.L / 2) + d;
+
+    const int x0 = std::max(lo, static_cast<int>(offset_x));
+    const int x1 = std::min(hi, static_cast<int>(offset_x + size_x));
+    const int y0 = std::max(lo, static_cast<int>(offset_y));
+    const int y1 = std::min(hi, static_cast<int>(offset_y + size_y));
+    const int z0 = std::max(lo, static_cast<int>(offset_z));
+    const int z1 = std::min(hi, static_cast<int>(offset_z + size_z));
+
+    for (int z = z0; z < z1; z++)
     {
-        for (int y = settings.L / 2 - d; y < settings.L / 2 + d; y++)
+        for (int y = y0; y < y1; y++)
         {
-            for (int x = settings.L / 2 - d; x < settings.L / 2 + d; x++)
+            for (int x = x0; x < x1; x++)
             {
-                if (!is_inside(x, y, z))
-                    continue;
                 int i = g2i(x, y, z);
                 u[i] = 0.25;
                 v[i] = 0.33;
@@ -116,8 +382,7 @@ double GrayScott::calcV(double tu, double tv) const
     return tu * tv * tv - (settings.F + settings.k) * tv;
 }
 
-double GrayScott::laplacian(int x, int y, int z,
-                            const std::vector<double> &s) const
+double GrayScott::laplacian(int x, int y, int z, const Field &s) const
 {
     double ts = 0.0;
     ts += s[l2i(x - 1, y, z)];
@@ -131,14 +396,92 @@ double GrayScott::laplacian(int x, int y, int z,
     return ts / 6.0;
 }
 
-void GrayScott::calc(const std::vector<double> &u, const std::vector<double> &v,
-                     std::vector<double> &u2, std::vector<double> &v2)
+void GrayScott::calc(const Field &u, const Field &v, Field &u2, Field &v2)
+{
+    calc_box<false>(u, v, u2, v2, 1, size_x + 1, 1, size_y + 1, 1,
+                    size_z + 1);
+}
+
+bool GrayScott::in_place() const
+{
+    return settings.in_place && settings.integrator == "euler" &&
+           !settings.amr && !(settings.active_bricks && settings.noise == 0.0);
+}
+
+void GrayScott::calc_in_place(Field &u, Field &v)
 {
+    // Plane z is computed from the old planes z - 1, z and z + 1. The old
+    // plane z is saved before it is overwritten and kept for plane z + 1,
+    // so two saved planes per field replace u2/v2. The arithmetic is that of
+    // calc_box(), the results are identical.
+    const int nx = size_x + 2;
+    const size_t P = static_cast<size_t>(nx) * (size_y + 2);
+    for (int k = 0; k < 2; k++)
+    {
+        plane_u[k].resize(P);
+        plane_v[k].resize(P);
+    }
+
+    // Old plane z - 1, at first the ghost plane which is never written
+    const double *u_below = &u[l2i(0, 0, 0)];
+    const double *v_below = &v[l2i(0, 0, 0)];
     for (int z = 1; z < size_z + 1; z++)
     {
+        double *uc = plane_u[z % 2].data();
+        double *vc = plane_v[z % 2].data();
+        std::copy(&u[l2i(0, 0, z)], &u[l2i(0, 0, z)] + P, uc);
+        std::copy(&v[l2i(0, 0, z)], &v[l2i(0, 0, z)] + P, vc);
+        const double *u_above = &u[l2i(0, 0, z + 1)];
+        const double *v_above = &v[l2i(0, 0, z + 1)];
+
         for (int y = 1; y < size_y + 1; y++)
         {
             for (int x = 1; x < size_x + 1; x++)
+            {
+                const int j = x + y * nx;
+                double lu = 0.0;
+                lu += uc[j - 1];
+                lu += uc[j + 1];
+                lu += uc[j - nx];
+                lu += uc[j + nx];
+                lu += u_below[j];
+                lu += u_above[j];
+                lu += -6.0 * uc[j];
+                double lv = 0.0;
+                lv += vc[j - 1];
+                lv += vc[j + 1];
+                lv += vc[j - nx];
+                lv += vc[j + nx];
+                lv += v_below[j];
+                lv += v_above[j];
+                lv += -6.0 * vc[j];
+
+                double du = settings.Du * (lu / 6.0);
+                double dv = settings.Dv * (lv / 6.0);
+                du += calcU(uc[j], vc[j]);
+                dv += calcV(uc[j], vc[j]);
+                du += settings.noise * uniform_dist(mt_gen);
+                const int i = l2i(x, y, z);
+                u[i] = uc[j] + du * settings.dt;
+                v[i] = vc[j] + dv * settings.dt;
+            }
+        }
+        u_below = uc;
+        v_below = vc;
+    }
+}
+
+template <bool Track>
+double GrayScott::calc_box(const Field &u, const Field &v, Field &u2,
+                           Field &v2, int x0, int x1, int y0, int y1, int z0,
+                           int z1)
+{
+    double dev = 0.0;
+    for (int z = z0; z < z1; z++)
+    {
+        for (int y = y0; y < y1; y++)
+        {
+            for (int x = x0; x < x1; x++)
             {
                 const int i = l2i(x, y, z);
                 double du = 0.0;
@@ -150,6 +493,171 @@ void GrayScott::calc(const std::vector<double> &u, const std::vector<double> &v,
                 du += settings.noise * uniform_dist(mt_gen);
                 u2[i] = u[i] + du * settings.dt;
                 v2[i] = v[i] + dv * settings.dt;
+                if (Track)
+                {
+                    dev = std::max(dev, std::max(std::abs(u2[i] - 1.0),
+                                                 std::abs(v2[i])));
+                }
+            }
+        }
+    }
+    return dev;
+}
+
+void GrayScott::init_bricks()
+{
+    const size_t B = std::max<size_t>(settings.brick_size, 1);
+    nbx = (size_x + B - 1) / B;
+    nby = (size_y + B - 1) / B;
+    nbz = (size_z + B - 1) / B;
+
+    // Every brick is computed in the first step, which establishes which
+    // ones deviate from the steady state
+    const size_t nb = nbx * nby * nbz;
+    brick_dev.assign(nb, 1);
+    brick_active.assign(nb, 1);
+    brick_synced.assign(nb, 0);
+
+    // Patches are tied to the bricks, regrid in the next step
+    fine.resize(size_x, size_y, size_z);
+    regrid_steps = 0;
+}
+
+size_t GrayScott::active_bricks() const
+{
+    if (!settings.active_bricks || settings.noise != 0.0)
+    {
+        return total_bricks();
+    }
+    return std::count(brick_active.begin(), brick_active.end(), 1);
+}
+
+size_t GrayScott::total_bricks() const { return nbx * nby * nbz; }
+
+void GrayScott::update_active_bricks()
+{
+    const int B = static_cast<int>(std::max<size_t>(settings.brick_size, 1));
+    const double tol = settings.active_tolerance;
+
+    // Does any cell in the (ghost) box deviate from the steady state
+    auto lf_deviates = [&](int x0, int x1, int y0, int y1, int z0, int z1) {
+        for (int z = z0; z < z1; z++)
+        {
+            for (int y = y0; y < y1; y++)
+            {
+                for (int x = x0; x < x1; x++)
+                {
+                    const int i = l2i(x, y, z);
+                    if (std::abs(u[i] - 1.0) > tol || std::abs(v[i]) > tol)
+                    {
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    };
+
+    for (size_t bz = 0; bz < nbz; bz++)
+    {
+        for (size_t by = 0; by < nby; by++)
+        {
+            for (size_t bx = 0; bx < nbx; bx++)
+            {
+                const size_t b = bx + nbx * (by + nby * bz);
+                const int x0 = 1 + bx * B;
+                const int x1 = std::min<int>(x0 + B, size_x + 1);
+                const int y0 = 1 + by * B;
+                const int y1 = std::min<int>(y0 + B, size_y + 1);
+                const int z0 = 1 + bz * B;
+                const int z1 = std::min<int>(z0 + B, size_z + 1);
+
+                // A brick changes if it or a face neighbor deviates
+                bool active = brick_dev[b] ||
+                              (bx > 0 && brick_dev[b - 1]) ||
+                              (bx + 1 < nbx && brick_dev[b + 1]) ||
+                              (by > 0 && brick_dev[b - nbx]) ||
+                              (by + 1 < nby && brick_dev[b + nbx]) ||
+                              (bz > 0 && brick_dev[b - nbx * nby]) ||
+                              (bz + 1 < nbz && brick_dev[b + nbx * nby]);
+
+                // Bricks on the block boundary also look at the ghost cells
+                // received from the neighbor ranks
+                if (!active && bx == 0)
+                {
+                    active = lf_deviates(0, 1, y0, y1, z0, z1);
+                }
+                if (!active && bx + 1 == nbx)
+                {
+                    active = lf_deviates(size_x + 1, size_x + 2, y0, y1, z0,
+                                         z1);
+                }
+                if (!active && by == 0)
+                {
+                    active = lf_deviates(x0, x1, 0, 1, z0, z1);
+                }
+                if (!active && by + 1 == nby)
+                {
+                    active = lf_deviates(x0, x1, size_y + 1, size_y + 2, z0,
+                                         z1);
+                }
+                if (!active && bz == 0)
+                {
+                    active = lf_deviates(x0, x1, y0, y1, 0, 1);
+                }
+                if (!active && bz + 1 == nbz)
+                {
+                    active = lf_deviates(x0, x1, y0, y1, size_z + 1,
+                                         size_z + 2);
+                }
+
+                brick_active[b] = active;
+            }
+        }
+    }
+}
+
+void GrayScott::calc_bricks(const Field &u, const Field &v, Field &u2,
+                            Field &v2)
+{
+    const int B = static_cast<int>(std::max<size_t>(settings.brick_size, 1));
+
+    for (size_t bz = 0; bz < nbz; bz++)
+    {
+        for (size_t by = 0; by < nby; by++)
+        {
+            for (size_t bx = 0; bx < nbx; bx++)
+            {
+                const size_t b = bx + nbx * (by + nby * bz);
+                const int x0 = 1 + bx * B;
+                const int x1 = std::min<int>(x0 + B, size_x + 1);
+                const int y0 = 1 + by * B;
+                const int y1 = std::min<int>(y0 + B, size_y + 1);
+                const int z0 = 1 + bz * B;
+                const int z1 = std::min<int>(z0 + B, size_z + 1);
+
+                if (brick_active[b])
+                {
+                    brick_dev[b] =
+                        calc_box<true>(u, v, u2, v2, x0, x1, y0, y1, z0, z1) >
+                        settings.active_tolerance;
+                    brick_synced[b] = 0;
+                }
+                else if (!brick_synced[b])
+                {
+                    // First step at rest: carry the values over once, after
+                    // that both buffers hold them and the brick is skipped
+                    for (int z = z0; z < z1; z++)
+                    {
+                        for (int y = y0; y < y1; y++)
+                        {
+                            const int i0 = l2i(x0, y, z);
+                            std::copy(&u[i0], &u[i0] + (x1 - x0), &u2[i0]);
+                            std::copy(&v[i0], &v[i0] + (x1 - x0), &v2[i0]);
+                        }
+                    }
+                    brick_synced[b] = 1;
+                }
             }
         }
     }
@@ -175,31 +683,39 @@ void GrayScott::init_mpi()
     py = coords[1];
     pz = coords[2];
 
-    size_x = settings.L / npx;
-    size_y = settings.L / npy;
-    size_z = settings.L / npz;
-
-    if (px < settings.L % npx)
-    {
-        size_x++;
-    }
-    if (py < settings.L % npy)
-    {
-        size_y++;
-    }
-    if (pz < settings.L % npz)
-    {
-        size_z++;
-    }
-
-    offset_x = (settings.L / npx * px) + std::min(settings.L % npx, px);
-    offset_y = (settings.L / npy * py) + std::min(settings.L % npy, py);
-    offset_z = (settings.L / npz * pz) + std::min(settings.L % npz, pz);
-
     MPI_Cart_shift(cart_comm, 0, 1, &west, &east);
     MPI_Cart_shift(cart_comm, 1, 1, &down, &up);
     MPI_Cart_shift(cart_comm, 2, 1, &south, &north);
 
+    // Start from the remainder-balanced split
+    auto lf_bounds = [](size_t n, size_t nparts) {
+        std::vector<size_t> bounds(nparts + 1, n);
+        size_t count;
+        for (size_t p = 0; p < nparts; p++)
+        {
+            decomp::block_1d(n, nparts, p, bounds[p], count);
+        }
+        return bounds;
+    };
+    bounds_x = lf_bounds(settings.L, npx);
+    bounds_y = lf_bounds(settings.L, npy);
+    bounds_z = lf_bounds(settings.L, npz);
+
+    xy_face_type = xz_face_type = yz_face_type = MPI_DATATYPE_NULL;
+    init_block();
+}
+
+void GrayScott::init_block()
+{
+    size_x = bounds_x[px + 1] - bounds_x[px];
+    size_y = bounds_y[py + 1] - bounds_y[py];
+    size_z = bounds_z[pz + 1] - bounds_z[pz];
+    offset_x = bounds_x[px];
+    offset_y = bounds_y[py];
+    offset_z = bounds_z[pz];
+
+    free_types();
+
     // XY faces: size_x * (size_y + 2)
     MPI_Type_vector(size_y + 2, size_x, size_x + 2, MPI_DOUBLE, &xy_face_type);
     MPI_Type_commit(&xy_face_type);
@@ -215,7 +731,178 @@ void GrayScott::init_mpi()
     MPI_Type_commit(&yz_face_type);
 }
 
-void GrayScott::exchange_xy(std::vector<double> &local_data) const
+void GrayScott::free_types()
+{
+    MPI_Datatype *types[] = {&xy_face_type, &xz_face_type, &yz_face_type};
+    for (auto type : types)
+    {
+        if (*type != MPI_DATATYPE_NULL)
+        {
+            MPI_Type_free(type);
+        }
+    }
+}
+
+void GrayScott::set_decomposition(const std::vector<size_t> &bx,
+                                  const std::vector<size_t> &by,
+                                  const std::vector<size_t> &bz)
+{
+    if (bx.size() != npx + 1 || by.size() != npy + 1 || bz.size() != npz + 1)
+    {
+        throw std::runtime_error(
+            "Decomposition does not match the process grid " +
+            std::to_string(npx) + "x" + std::to_string(npy) + "x" +
+            std::to_string(npz));
+    }
+    bounds_x = bx;
+    bounds_y = by;
+    bounds_z = bz;
+    init_block();
+
+    const size_t V = (size_x + 2) * (size_y + 2) * (size_z + 2);
+    u.resize(V);
+    v.resize(V);
+    u2.resize(in_place() ? 0 : V);
+    v2.resize(in_place() ? 0 : V);
+    init_bricks();
+}
+
+bool GrayScott::rebalance()
+{
+    const double t = compute_time;
+    compute_time = 0.0;
+    window_steps = 0;
+
+    double t_max, t_sum;
+    MPI_Allreduce(&t, &t_max, 1, MPI_DOUBLE, MPI_MAX, comm);
+    MPI_Allreduce(&t, &t_sum, 1, MPI_DOUBLE, MPI_SUM, comm);
+    if (t_sum <= 0.0 || t_max / (t_sum / procs) < settings.rebalance_threshold)
+    {
+        return false;
+    }
+
+    // Cost of every global slab along each axis, assuming the cost of a
+    // block is spread evenly over its cells. The process grid stays
+    // Cartesian, so the split along each axis is a weighted 1D split of the
+    // slab costs and every rank keeps one neighbor per face.
+    const size_t L = settings.L;
+    std::vector<double> cost(3 * L, 0.0);
+    for (size_t i = 0; i < size_x; i++)
+    {
+        cost[offset_x + i] += t / size_x;
+    }
+    for (size_t i = 0; i < size_y; i++)
+    {
+        cost[L + offset_y + i] += t / size_y;
+    }
+    for (size_t i = 0; i < size_z; i++)
+    {
+        cost[2 * L + offset_z + i] += t / size_z;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, cost.data(), 3 * L, MPI_DOUBLE, MPI_SUM,
+                  comm);
+
+    std::vector<size_t> old[3] = {bounds_x, bounds_y, bounds_z};
+    bounds_x = decomp::weighted_1d(
+        std::vector<double>(cost.begin(), cost.begin() + L), npx);
+    bounds_y = decomp::weighted_1d(
+        std::vector<double>(cost.begin() + L, cost.begin() + 2 * L), npy);
+    bounds_z = decomp::weighted_1d(
+        std::vector<double>(cost.begin() + 2 * L, cost.end()), npz);
+
+    if (bounds_x == old[0] && bounds_y == old[1] && bounds_z == old[2])
+    {
+        return false;
+    }
+
+    init_block();
+    Field new_u = migrate(u, old);
+    Field new_v = migrate(v, old);
+
+    u.swap(new_u);
+    v.swap(new_v);
+    const size_t V = (size_x + 2) * (size_y + 2) * (size_z + 2);
+    u2.resize(in_place() ? 0 : V);
+    v2.resize(in_place() ? 0 : V);
+    init_bricks();
+    return true;
+}
+
+GrayScott::Field GrayScott::migrate(const Field &data,
+                                    const std::vector<size_t> *old) const
+{
+    const std::vector<size_t> *now[3] = {&bounds_x, &bounds_y, &bounds_z};
+    const std::vector<size_t> *before[3] = {&old[0], &old[1], &old[2]};
+    int me[3] = {static_cast<int>(px), static_cast<int>(py),
+                 static_cast<int>(pz)};
+    Field result((size_x + 2) * (size_y + 2) * (size_z + 2));
+
+    std::vector<MPI_Request> requests;
+    std::vector<MPI_Datatype> types;
+    for (int r = 0; r < procs; r++)
+    {
+        int c[3];
+        MPI_Cart_coords(cart_comm, r, 3, c);
+
+        // 0: what this rank sends to r, 1: what it receives from r
+        for (int dir = 0; dir < 2; dir++)
+        {
+            // overlap of the old block of src_c with the new block of dst_c,
+            // addressed in the old or new local array of this rank
+            const int *src_c = dir == 0 ? me : c;
+            const int *dst_c = dir == 0 ? c : me;
+            const std::vector<size_t> *const *local = dir == 0 ? before : now;
+
+            int sizes[3], subsizes[3], starts[3];
+            bool empty = false;
+            for (int d = 0; d < 3; d++)
+            {
+                const std::vector<size_t> &sb = *before[d], &db = *now[d];
+                const size_t lo = std::max(sb[src_c[d]], db[dst_c[d]]);
+                const size_t hi = std::min(sb[src_c[d] + 1], db[dst_c[d] + 1]);
+                if (lo >= hi)
+                {
+                    empty = true;
+                    break;
+                }
+                const std::vector<size_t> &lb = *local[d];
+                sizes[d] = lb[me[d] + 1] - lb[me[d]] + 2;
+                subsizes[d] = hi - lo;
+                starts[d] = lo - lb[me[d]] + 1;
+            }
+            if (empty)
+            {
+                continue;
+            }
+
+            MPI_Datatype type;
+            MPI_Type_create_subarray(3, sizes, subsizes, starts,
+                                     MPI_ORDER_FORTRAN, MPI_DOUBLE, &type);
+            MPI_Type_commit(&type);
+            types.push_back(type);
+
+            requests.emplace_back();
+            if (dir == 0)
+            {
+                MPI_Isend(data.data(), 1, type, r, 0, cart_comm,
+                          &requests.back());
+            }
+            else
+            {
+                MPI_Irecv(result.data(), 1, type, r, 0, cart_comm,
+                          &requests.back());
+            }
+        }
+    }
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+    for (auto &type : types)
+    {
+        MPI_Type_free(&type);
+    }
+    return result;
+}
+
+void GrayScott::exchange_xy(Field &local_data) const
 {
     MPI_Status st;
 
@@ -229,7 +916,7 @@ void GrayScott::exchange_xy(std::vector<double> &local_data) const
                  cart_comm, &st);
 }
 
-void GrayScott::exchange_xz(std::vector<double> &local_data) const
+void GrayScott::exchange_xz(Field &local_data) const
 {
     MPI_Status st;
 
@@ -243,7 +930,7 @@ void GrayScott::exchange_xz(std::vector<double> &local_data) const
                  cart_comm, &st);
 }
 
-void GrayScott::exchange_yz(std::vector<double> &local_data) const
+void GrayScott::exchange_yz(Field &local_data) const
 {
     MPI_Status st;
 
@@ -257,7 +944,7 @@ void GrayScott::exchange_yz(std::vector<double> &local_data) const
                  cart_comm, &st);
 }
 
-void GrayScott::exchange(std::vector<double> &u, std::vector<double> &v) const
+void GrayScott::exchange(Field &u, Field &v) const
 {
     exchange_xy(u);
     exchange_xz(u);
@@ -268,7 +955,75 @@ void GrayScott::exchange(std::vector<double> &u, std::vector<double> &v) const
     exchange_yz(v);
 }
 
-void GrayScott::data_no_ghost_common(const std::vector<double> &data,
+void GrayScott::data_noghost(const Field &data, double *data_no_ghost,
+                             std::vector<Slice> &slices) const
+{
+    // Local plane (ghost layer included) of every slice, 0 if it misses
+    // the block. x and y slices take something from every row.
+    const size_t offset[3] = {offset_x, offset_y, offset_z};
+    const size_t size[3] = {size_x, size_y, size_z};
+    std::vector<int> plane(slices.size(), 0);
+    bool all_rows = data_no_ghost != nullptr;
+    for (size_t s = 0; s < slices.size(); s++)
+    {
+        Slice &slice = slices[s];
+        const int a = slice.axis;
+        if (slice.index >= offset[a] && slice.index < offset[a] + size[a])
+        {
+            plane[s] = static_cast<int>(slice.index - offset[a]) + 1;
+            slice.data.resize(size_x * size_y * size_z / size[a]);
+            all_rows = all_rows || a != 2;
+        }
+        else
+        {
+            slice.data.clear();
+        }
+    }
+
+    for (int z = 1; z < size_z + 1; z++)
+    {
+        if (!all_rows &&
+            std::find(plane.begin(), plane.end(), z) == plane.end())
+        {
+            continue;
+        }
+        for (int y = 1; y < size_y + 1; y++)
+        {
+            const double *row = &data[l2i(1, y, z)];
+            if (data_no_ghost)
+            {
+                std::copy(row, row + size_x,
+                          data_no_ghost + (y - 1) * size_x +
+                              (z - 1) * size_x * size_y);
+            }
+            for (size_t s = 0; s < slices.size(); s++)
+            {
+                Slice &slice = slices[s];
+                if (!plane[s])
+                {
+                    continue;
+                }
+                if (slice.axis == 2 && z == plane[s])
+                {
+                    std::copy(row, row + size_x,
+                              slice.data.begin() + (y - 1) * size_x);
+                }
+                else if (slice.axis == 1 && y == plane[s])
+                {
+                    std::copy(row, row + size_x,
+                              slice.data.begin() + (z - 1) * size_x);
+                }
+                else if (slice.axis == 0)
+                {
+                    slice.data[(z - 1) * size_y + (y - 1)] =
+                        row[plane[s] - 1];
+                }
+            }
+        }
+    }
+}
+
+void GrayScott::data_no_ghost_common(const Field &data,
                                      double *data_no_ghost) const
 {
     for (int z = 1; z < size_z + 1; z++)
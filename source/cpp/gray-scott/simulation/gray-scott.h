@@ -1,16 +1,50 @@
 #ifndef __GRAY_SCOTT_H__
 #define __GRAY_SCOTT_H__
 
+#include <memory>
 #include <random>
+#include <utility>
 #include <vector>
 
 #include <mpi.h>
 
+#include "../../gray-scott/simulation/refinement.h"
 #include "../../gray-scott/simulation/settings.h"
 
+// Allocator that default-initializes elements instead of value-initializing
+// them, so resizing a field does not write it. The pages of a field are then
+// first touched by the code that computes it, on the core running this rank.
+template <class T>
+class default_init_allocator : public std::allocator<T>
+{
+public:
+    template <class U>
+    struct rebind
+    {
+        using other = default_init_allocator<U>;
+    };
+
+    using std::allocator<T>::allocator;
+
+    template <class U>
+    void construct(U *p)
+    {
+        ::new (static_cast<void *>(p)) U;
+    }
+
+    template <class U, class... Args>
+    void construct(U *p, Args &&... args)
+    {
+        ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
 class GrayScott
 {
 public:
+    // Ghosted local field, (size_x + 2) * (size_y + 2) * (size_z + 2)
+    using Field = std::vector<double, default_init_allocator<double>>;
+
     // Dimension of process grid
     size_t npx, npy, npz;
     // Coordinate of this rank in process grid
@@ -19,6 +53,9 @@ public:
     size_t size_x, size_y, size_z;
     // Offset of local array in the global array
     size_t offset_x, offset_y, offset_z;
+    // Block boundaries along each axis of the process grid, npx + 1 (npy +
+    // 1, npz + 1) entries. Not uniform after load rebalancing.
+    std::vector<size_t> bounds_x, bounds_y, bounds_z;
 
     GrayScott(const Settings &settings, MPI_Comm comm);
     ~GrayScott();
@@ -26,9 +63,18 @@ public:
     void init();
     void iterate();
     void restart(std::vector<double> &u, std::vector<double> &v);
+    // Restart from u and v without ghosts, as written to the output. The
+    // ghost cells are filled by a halo exchange.
+    void restart_noghost(const std::vector<double> &u,
+                         const std::vector<double> &v);
+    // Switch to the given block boundaries without moving data, e.g. before
+    // restarting from a checkpoint written after rebalancing
+    void set_decomposition(const std::vector<size_t> &bx,
+                           const std::vector<size_t> &by,
+                           const std::vector<size_t> &bz);
 
-    const std::vector<double> &u_ghost() const;
-    const std::vector<double> &v_ghost() const;
+    const Field &u_ghost() const;
+    const Field &v_ghost() const;
 
     std::vector<double> u_noghost() const;
     std::vector<double> v_noghost() const;
@@ -36,10 +82,38 @@ public:
     void u_noghost(double *u_no_ghost) const;
     void v_noghost(double *v_no_ghost) const;
 
+    // An axis-aligned plane of the global field, axis 0, 1, 2 for x, y, z
+    // and index along it. data receives the part of the plane in the local
+    // block, over the two other axes slowest first (z, y, x), and is left
+    // empty if the plane misses the block.
+    struct Slice
+    {
+        int axis;
+        size_t index;
+        std::vector<double> data;
+    };
+    // u_noghost/v_noghost that fills the slices in the same pass over the
+    // block. With a null u_no_ghost only the slices are extracted.
+    void u_noghost(double *u_no_ghost, std::vector<Slice> &slices) const;
+    void v_noghost(double *v_no_ghost, std::vector<Slice> &slices) const;
+
+    // Number of local bricks computed in the last step, and in total
+    size_t active_bricks() const;
+    size_t total_bricks() const;
+
+    // Simulated time, current time step and CG iterations of the last
+    // implicit solve
+    double time() const { return sim_time; }
+    double time_step() const { return dt; }
+    int solver_iterations() const { return cg_iterations; }
+
+    // Refined patches over the local block, if settings.amr
+    const Refinement &refinement() const { return fine; }
+
 protected:
     Settings settings;
 
-    std::vector<double> u, v, u2, v2;
+    Field u, v, u2, v2;
 
     int rank, procs;
     int west, east, up, down, north, south;
@@ -55,36 +129,98 @@ protected:
     std::mt19937 mt_gen;
     std::uniform_real_distribution<double> uniform_dist;
 
+    // Active brick tracking: the local block is split into bricks of
+    // settings.brick_size^3 cells and only bricks away from the u=1, v=0
+    // steady state (or next to one) are computed
+    size_t nbx, nby, nbz;
+    // A cell of the brick deviates from the steady state
+    std::vector<char> brick_dev;
+    // The brick is computed in the current step
+    std::vector<char> brick_active;
+    // u/u2 and v/v2 hold the same values for the (inactive) brick
+    std::vector<char> brick_synced;
+
+    // Saved old z-planes of the in-place update, (size_x + 2) * (size_y + 2)
+    std::vector<double> plane_u[2], plane_v[2];
+
+    // Time integration: simulated time, current (adaptive) time step
+    double sim_time;
+    double dt;
+    int cg_iterations;
+    // CG residuals, search directions and their images for u and v
+    Field cg_ru, cg_rv, cg_pu, cg_pv, cg_qu, cg_qv;
+
+    // Refined level and steps since the last regrid
+    Refinement fine;
+    int regrid_steps;
+
+    // Load rebalancing: compute time and steps since the last rebalance
+    double compute_time;
+    int window_steps;
+
     // Setup cartesian communicator data types
     void init_mpi();
-    // Setup initial conditions
+    // Local block from the boundaries, and halo datatypes for it
+    void init_block();
+    void free_types();
+    // Recompute the block boundaries from the measured compute time and move
+    // the fields over, returns whether the decomposition changed
+    bool rebalance();
+    // Move field data from the block boundaries 'old' to the current ones
+    Field migrate(const Field &data, const std::vector<size_t> *old) const;
+    // Allocate the fields and, unless restarting, set initial conditions
     void init_field();
+    // Setup the brick grid, with every brick active
+    void init_bricks();
 
+    // Advance one step with implicit diffusion and explicit reaction,
+    // adapting dt if settings.dt_tolerance is set
+    void iterate_imex();
+    // Solve (I - dt D lap) x = y + dt R(y) for u and v with CG, returns the
+    // number of iterations
+    int solve_imex(const Field &u, const Field &v, Field &u2, Field &v2,
+                   double dt);
+    // Local error estimate of the explicit reaction term over the step
+    double imex_error(const Field &u, const Field &v, const Field &u2,
+                      const Field &v2, double dt) const;
+
+    // Whether iterate() updates u/v in place, without u2/v2
+    bool in_place() const;
+    // Progress simulation for one timestep, overwriting u and v
+    void calc_in_place(Field &u, Field &v);
     // Progess simulation for one timestep
-    void calc(const std::vector<double> &u, const std::vector<double> &v,
-              std::vector<double> &u2, std::vector<double> &v2);
+    void calc(const Field &u, const Field &v, Field &u2, Field &v2);
+    // Progress simulation for one timestep on active bricks only
+    void calc_bricks(const Field &u, const Field &v, Field &u2, Field &v2);
+    // Progress the cells in [x0, x1) x [y0, y1) x [z0, z1), optionally
+    // returning the max deviation of the result from the steady state
+    template <bool Track>
+    double calc_box(const Field &u, const Field &v, Field &u2, Field &v2,
+                    int x0, int x1, int y0, int y1, int z0, int z1);
+    // Mark the bricks to compute from the deviation of the bricks and of the
+    // ghost cells received in the last exchange
+    void update_active_bricks();
     // Compute reaction term for U
     double calcU(double tu, double tv) const;
     // Compute reaction term for V
     double calcV(double tu, double tv) const;
     // Compute laplacian of field s at (ix, iy, iz)
-    double laplacian(int ix, int iy, int iz,
-                     const std::vector<double> &s) const;
+    double laplacian(int ix, int iy, int iz, const Field &s) const;
 
     // Exchange faces with neighbors
-    void exchange(std::vector<double> &u, std::vector<double> &v) const;
+    void exchange(Field &u, Field &v) const;
     // Exchange XY faces with north/south
-    void exchange_xy(std::vector<double> &local_data) const;
+    void exchange_xy(Field &local_data) const;
     // Exchange XZ faces with up/down
-    void exchange_xz(std::vector<double> &local_data) const;
+    void exchange_xz(Field &local_data) const;
     // Exchange YZ faces with west/east
-    void exchange_yz(std::vector<double> &local_data) const;
+    void exchange_yz(Field &local_data) const;
 
     // Return a copy of data with ghosts removed
-    std::vector<double> data_noghost(const std::vector<double> &data) const;
+    std::vector<double> data_noghost(const Field &data) const;
 
     // pointer version
-    void data_noghost(const std::vector<double> &data, double *no_ghost) const;
+    void data_noghost(const Field &data, double *no_ghost) const;
 
     // Check if point is included in my subdomain
     inline bool is_inside(int x, int y, int z) const
@@ -118,10 +254,26 @@ protected:
     {
         return x + y * (size_x + 2) + z * (size_x + 2) * (size_y + 2);
     }
+    // Call f(x, y, z, index) for every interior cell
+    template <class F>
+    inline void for_each_cell(F f) const
+    {
+        for (int z = 1; z < size_z + 1; z++)
+        {
+            for (int y = 1; y < size_y + 1; y++)
+            {
+                for (int x = 1; x < size_x + 1; x++)
+                {
+                    f(x, y, z, l2i(x, y, z));
+                }
+            }
+        }
+    }
 
 private:
-    void data_no_ghost_common(const std::vector<double> &data,
-                              double *data_no_ghost) const;
+    void data_no_ghost_common(const Field &data, double *data_no_ghost) const;
+    void data_noghost(const Field &data, double *data_no_ghost,
+                      std::vector<Slice> &slices) const;
 };
 
 #endif
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -9,6 +10,8 @@
 #include <mpi.h>
 
 #include "../../gray-scott/common/timer.hpp"
+#include "../../gray-scott/simulation/forward.h"
+#include "../../gray-scott/simulation/gray-scott-batch.h"
 #include "../../gray-scott/simulation/gray-scott.h"
 #include "../../gray-scott/simulation/restart.h"
 #include "../../gray-scott/simulation/writer.h"
@@ -18,6 +21,7 @@ struct SimulationPerformanceMetrics {
     double io_write_time = 0.0;
     double io_checkpoint_time = 0.0;
     double computation_time = 0.0;
+    double startup_time = 0.0;
     double initialization_time = 0.0;
     double total_time = 0.0;
     double data_size_gb = 0.0;
@@ -64,6 +68,11 @@ void print_settings(const Settings &s, int restart_step)
     std::cout << "Du:               " << s.Du << std::endl;
     std::cout << "Dv:               " << s.Dv << std::endl;
     std::cout << "noise:            " << s.noise << std::endl;
+    if (s.members() > 1)
+    {
+        std::cout << "ensemble:         " << s.members()
+                  << " members, F and k above are member 0" << std::endl;
+    }
     std::cout << "output:           " << s.output << std::endl;
     std::cout << "adios_config:     " << s.adios_config << std::endl;
 }
@@ -85,6 +94,7 @@ void print_performance_summary(const SimulationPerformanceMetrics &metrics, int
                   << "\n========================================"
                   << std::fixed << std::setprecision(4)
                   << "\nTotal execution time:     " << metrics.total_time << " seconds"
+                  << "\nStartup time (max):       " << metrics.startup_time << " seconds"
                   << "\nInitialization time:      " << metrics.initialization_time << " seconds"
                   << "\nComputation time:         " << metrics.computation_time << " seconds"
                   << "\nI/O write time:           " << metrics.io_write_time << " seconds"
@@ -118,15 +128,101 @@ void print_performance_summary(const SimulationPerformanceMetrics &metrics, int
     }
 }
 
-double calculate_data_size_mb(const GrayScott &sim)
+double calculate_data_size_mb(const Settings &settings, const GrayScott &sim,
+                              int step)
 {
-    // Calculate size in MB for U + V + step data
-    size_t u_size = sim.size_x * sim.size_y * sim.size_z * sizeof(double);
-    size_t v_size = sim.size_x * sim.size_y * sim.size_z * sizeof(double);
+    // Calculate size in MB for U + V + step data, U and V when due
+    const size_t field_size =
+        sim.size_x * sim.size_y * sim.size_z * sizeof(double);
+    size_t u_size = settings.output_u_at(step) ? field_size : 0;
+    size_t v_size = settings.output_v_at(step) ? field_size : 0;
     size_t step_size = sizeof(int);
     return (u_size + v_size + step_size) / (1024.0 * 1024.0);
 }
 
+// Ensemble members batched ensemble_batch at a time per group of ranks,
+// explicit steps and output only
+void run_batch(const Settings &settings, MPI_Comm comm, MPI_Comm sim_comm,
+               int first_member, int members, adios2::ADIOS &adios)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    GrayScottBatch sim(settings, sim_comm, first_member, members);
+    sim.init();
+
+    adios2::IO io_main = adios.DeclareIO("SimulationOutput");
+    Writer writer_main(settings, sim, io_main);
+    writer_main.open(settings.output, 0, comm);
+
+    if (rank == 0)
+    {
+        print_io_settings(io_main);
+        std::cout << "========================================" << std::endl;
+        print_settings(settings, 0);
+        std::cout << "batch:            " << settings.ensemble_batch
+                  << " members per group of processes" << std::endl;
+        std::cout << "process layout:   " << sim.npx << "x" << sim.npy << "x"
+                  << sim.npz << std::endl;
+        std::cout << "========================================" << std::endl;
+    }
+
+    double compute_time = 0.0;
+    for (int it = 0; it < settings.steps;)
+    {
+        auto start_compute = std::chrono::high_resolution_clock::now();
+        sim.iterate();
+        it++;
+        compute_time += std::chrono::duration<double>(
+                            std::chrono::high_resolution_clock::now() -
+                            start_compute)
+                            .count();
+
+        if (it % settings.plotgap == 0)
+        {
+            if (rank == 0)
+            {
+                std::cout << "Simulation at step " << it
+                          << " writing output step     "
+                          << it / settings.plotgap << std::endl;
+            }
+            writer_main.write(it, sim);
+        }
+    }
+
+    writer_main.close();
+
+    double compute_time_max = 0.0;
+    MPI_Reduce(&compute_time, &compute_time_max, 1, MPI_DOUBLE, MPI_MAX, 0,
+               comm);
+    if (rank == 0)
+    {
+        std::cout << "Computation time (max):   " << compute_time_max
+                  << " seconds for " << settings.members() << " members"
+                  << std::endl;
+    }
+}
+
+// I/O rank with io_ranks_per_node: writes the output of the compute ranks in
+// clients, comm is the communicator of both, io_comm that of the I/O ranks
+void run_io_server(const Settings &settings, MPI_Comm comm, MPI_Comm io_comm,
+                   const std::vector<int> &clients, adios2::ADIOS &adios)
+{
+    // The compute ranks tell the step they restarted from
+    int restart_step = 0;
+    MPI_Allreduce(MPI_IN_PLACE, &restart_step, 1, MPI_INT, MPI_MAX, comm);
+
+    adios2::IO io_main = adios.DeclareIO("SimulationOutput");
+    if (restart_step > 0)
+    {
+        io_main.SetParameter("AppendAfterSteps",
+                             std::to_string(restart_step / settings.plotgap));
+    }
+
+    ForwardServer server(settings, comm, io_comm, clients, io_main);
+    server.run(settings.output, restart_step);
+}
+
 int main(int argc, char **argv)
 {
     // Start overall timing
@@ -161,25 +257,164 @@ int main(int argc, char **argv)
     // Start initialization timing
     auto start_init = std::chrono::high_resolution_clock::now();
 
-    Settings settings = Settings::from_json(argv[1]);
+    // settings.json is read by rank 0 only and broadcast. The ADIOS2 XML
+    // config is handled the same way inside ADIOS2 when it is given a
+    // communicator, so neither file is opened by every rank.
+    Settings settings = Settings::from_json(argv[1], comm);
+
+    adios2::ADIOS adios(settings.adios_config, comm);
+
+    // Startup: MPI, configuration files and ADIOS2, everything before the
+    // simulation itself is set up
+    auto end_startup = std::chrono::high_resolution_clock::now();
+    perf_metrics.startup_time = std::chrono::duration<double>(end_startup - start_total).count();
 
-    GrayScott sim(settings, comm);
+    // The imex step has no bricks, patches or rebalancing, they would be
+    // silently ignored
+    if (settings.integrator == "imex" &&
+        (settings.amr || settings.active_bricks ||
+         settings.rebalance_interval > 0))
+    {
+        if (rank == 0)
+        {
+            std::cerr << "integrator imex is not supported with amr, "
+                         "active_bricks or rebalance_interval"
+                      << std::endl;
+        }
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+
+    // Ensemble run: the ranks are split into one contiguous group per member,
+    // each group runs its own simulation and all of them write into the one
+    // output of this ADIOS2 instance
+    const int members = settings.members();
+    MPI_Comm sim_comm = comm;
+    if (members > 1 && settings.ensemble_batch > 1)
+    {
+        // The batched stencil is explicit and plain, anything else would be
+        // silently ignored
+        if (settings.noise != 0.0 || settings.checkpoint ||
+            settings.restart || settings.integrator != "euler" ||
+            settings.in_place || settings.active_bricks || settings.amr ||
+            !settings.slice_axis.empty() || settings.rebalance_interval > 0 ||
+            settings.io_ranks_per_node > 0)
+        {
+            if (rank == 0)
+            {
+                std::cerr << "ensemble_batch is not supported with noise, "
+                             "checkpoint, restart, integrator imex, "
+                             "in_place, active_bricks, amr, output_slices, "
+                             "rebalance_interval or io_ranks_per_node"
+                          << std::endl;
+            }
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+
+        // Each group of ranks advances ensemble_batch members together
+        const int batch = settings.ensemble_batch;
+        const int groups = (members + batch - 1) / batch;
+        if (procs < groups)
+        {
+            if (rank == 0)
+            {
+                std::cerr << "Ensemble of " << groups
+                          << " batches needs at least as many processes, got "
+                          << procs << std::endl;
+            }
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        const int group = static_cast<int>(
+            static_cast<long long>(rank) * groups / procs);
+        MPI_Comm_split(comm, group, rank, &sim_comm);
+        const int first = group * batch;
+        run_batch(settings.for_member(first), comm, sim_comm, first,
+                  std::min(batch, members - first), adios);
+        MPI_Finalize();
+        return 0;
+    }
+    if (members > 1)
+    {
+        if (procs < members)
+        {
+            if (rank == 0)
+            {
+                std::cerr << "Ensemble of " << members
+                          << " members needs at least as many processes, got "
+                          << procs << std::endl;
+            }
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        const int member = static_cast<int>(
+            static_cast<long long>(rank) * members / procs);
+        MPI_Comm_split(comm, member, rank, &sim_comm);
+        settings = settings.for_member(member);
+    }
+
+    // With I/O ranks, these leave for run_io_server and from here on comm
+    // holds the compute ranks only. forward_comm keeps both.
+    MPI_Comm forward_comm = comm;
+    int io_server = -1;
+    if (settings.io_ranks_per_node > 0)
+    {
+        if (members > 1 || settings.amr || !settings.slice_axis.empty())
+        {
+            if (rank == 0)
+            {
+                std::cerr << "io_ranks_per_node is not supported with "
+                             "ensembles, amr or output_slices"
+                          << std::endl;
+            }
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        std::vector<int> io_clients;
+        MPI_Comm part;
+        if (split_io_ranks(settings, comm, part, io_server, io_clients))
+        {
+            run_io_server(settings, forward_comm, part, io_clients, adios);
+            MPI_Finalize();
+            return 0;
+        }
+        comm = part;
+        sim_comm = part;
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm_size(comm, &procs);
+    }
+
+    GrayScott sim(settings, sim_comm);
     sim.init();
 
-    adios2::ADIOS adios(settings.adios_config, comm);
     adios2::IO io_main = adios.DeclareIO("SimulationOutput");
-    adios2::IO io_ckpt = adios.DeclareIO("SimulationCheckpoint");
+    // Only declared when used, so an unused checkpoint IO section does not
+    // cost anything
+    adios2::IO io_ckpt;
+    if (settings.checkpoint || settings.restart)
+    {
+        io_ckpt = adios.DeclareIO("SimulationCheckpoint");
+    }
 
     int restart_step = 0;
     if (settings.restart)
     {
-        restart_step = ReadRestart(comm, settings, sim, io_ckpt);
+        restart_step = ReadRestart(sim_comm, settings, sim, io_ckpt);
         io_main.SetParameter("AppendAfterSteps",
                              std::to_string(restart_step / settings.plotgap));
     }
 
     Writer writer_main(settings, sim, io_main);
-    writer_main.open(settings.output, (restart_step > 0));
+    ForwardClient forward(forward_comm, io_server);
+    if (settings.io_ranks_per_node > 0)
+    {
+        MPI_Allreduce(MPI_IN_PLACE, &restart_step, 1, MPI_INT, MPI_MAX,
+                      forward_comm);
+    }
+    else
+    {
+        writer_main.open(settings.output, restart_step, comm);
+    }
+
+    // Members write their output steps together, so the decision is taken
+    // once for the whole job and all of them checkpoint on the same step
+    CheckpointScheduler ckpt_schedule(settings, comm);
 
     // End initialization timing
     auto end_init = std::chrono::high_resolution_clock::now();
@@ -241,10 +476,52 @@ int main(int argc, char **argv)
                           << it / settings.plotgap << std::endl;
             }
 
+            if (settings.active_bricks)
+            {
+                unsigned long long bricks[2] = {sim.active_bricks(),
+                                                sim.total_bricks()};
+                unsigned long long bricks_all[2] = {0, 0};
+                MPI_Reduce(bricks, bricks_all, 2, MPI_UNSIGNED_LONG_LONG,
+                           MPI_SUM, 0, comm);
+                if (rank == 0)
+                {
+                    std::cout << "    active bricks: " << bricks_all[0]
+                              << " of " << bricks_all[1] << std::endl;
+                }
+            }
+
+            if (settings.integrator == "imex" && rank == 0)
+            {
+                std::cout << "    time: " << sim.time()
+                          << " dt: " << sim.time_step()
+                          << " CG iterations: " << sim.solver_iterations()
+                          << std::endl;
+            }
+
+            if (settings.amr)
+            {
+                unsigned long long patches = sim.refinement().patches().size();
+                unsigned long long patches_all = 0;
+                MPI_Reduce(&patches, &patches_all, 1, MPI_UNSIGNED_LONG_LONG,
+                           MPI_SUM, 0, comm);
+                if (rank == 0)
+                {
+                    std::cout << "    refined patches: " << patches_all
+                              << std::endl;
+                }
+            }
+
             // Start I/O write timing
             auto start_write = std::chrono::high_resolution_clock::now();
             
-            writer_main.write(it, sim);
+            if (settings.io_ranks_per_node > 0)
+            {
+                forward.write(it, sim);
+            }
+            else
+            {
+                writer_main.write(it, sim);
+            }
             
             // End I/O write timing and calculate data size
             auto end_write = std::chrono::high_resolution_clock::now();
@@ -253,23 +530,28 @@ int main(int argc, char **argv)
             perf_metrics.step_write_times.push_back(write_time);
             
             // Calculate data size for this write
-            double data_size_mb = calculate_data_size_mb(sim);
+            double data_size_mb = calculate_data_size_mb(settings, sim, it);
             perf_metrics.step_data_sizes_mb.push_back(data_size_mb);
             perf_metrics.data_size_gb += data_size_mb / 1024.0;
             perf_metrics.total_writes++;
         }
 
-        if (settings.checkpoint && (it % settings.checkpoint_freq) == 0)
+        if (settings.checkpoint && ckpt_schedule.due(it))
         {
+            // The output step still draining in the background would
+            // compete with the checkpoint for the file system
+            writer_main.wait();
+
             // Start checkpoint timing
             auto start_checkpoint = std::chrono::high_resolution_clock::now();
             
-            WriteCkpt(comm, it, settings, sim, io_ckpt);
+            WriteCkpt(sim_comm, it, settings, sim, io_ckpt);
             
             // End checkpoint timing
             auto end_checkpoint = std::chrono::high_resolution_clock::now();
             double checkpoint_time = std::chrono::duration<double>(end_checkpoint - start_checkpoint).count();
             perf_metrics.io_checkpoint_time += checkpoint_time;
+            ckpt_schedule.written(checkpoint_time);
             
             // Estimate checkpoint size (full U + V arrays with ghosts)
             size_t full_array_size = (sim.size_x + 2) * (sim.size_y + 2) * (sim.size_z + 2) * sizeof(double);
@@ -289,13 +571,21 @@ int main(int argc, char **argv)
 #endif
     }
 
-    writer_main.close();
+    if (settings.io_ranks_per_node > 0)
+    {
+        forward.close();
+    }
+    else
+    {
+        writer_main.close();
+    }
 
     // Calculate total execution time
     auto end_total = std::chrono::high_resolution_clock::now();
     perf_metrics.total_time = std::chrono::duration<double>(end_total - start_total).count();
 
     // Aggregate performance metrics across all processes
+    double startup_time_max = 0.0;
     double total_write_time_all = 0.0;
     double total_checkpoint_time_all = 0.0;
     double total_compute_time_all = 0.0;
@@ -304,6 +594,7 @@ int main(int argc, char **argv)
     int total_writes_all = 0;
     int total_checkpoints_all = 0;
 
+    MPI_Reduce(&perf_metrics.startup_time, &startup_time_max, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
     MPI_Reduce(&perf_metrics.io_write_time, &total_write_time_all, 1, MPI_DOUBLE, MPI_SUM, 0, comm);
     MPI_Reduce(&perf_metrics.io_checkpoint_time, &total_checkpoint_time_all, 1, MPI_DOUBLE, MPI_SUM, 0, comm);
     MPI_Reduce(&perf_metrics.computation_time, &total_compute_time_all, 1, MPI_DOUBLE, MPI_SUM, 0, comm);
@@ -315,6 +606,8 @@ int main(int argc, char **argv)
     // Update metrics with aggregated values for rank 0
     if (rank == 0)
     {
+        // Startup is bound by the slowest rank
+        perf_metrics.startup_time = startup_time_max;
         // Use average times across processes for meaningful metrics
         perf_metrics.io_write_time = total_write_time_all / procs;
         perf_metrics.io_checkpoint_time = total_checkpoint_time_all / procs;
@@ -327,6 +620,10 @@ int main(int argc, char **argv)
 
     // Print performance summary
     print_performance_summary(perf_metrics, rank, procs, settings);
+    if (rank == 0 && settings.checkpoint)
+    {
+        ckpt_schedule.print_summary(perf_metrics.total_time);
+    }
 
     // Output per-step throughput CSV for plotting
     if (rank == 0 && !perf_metrics.step_write_times.empty())
@@ -335,7 +632,15 @@ int main(int argc, char **argv)
         std::ofstream csv_file(csv_filename);
         if (csv_file.is_open())
         {
-            csv_file << "write_number,step,write_time_sec,data_size_mb,throughput_mb_s,cumulative_time_sec,cumulative_data_mb\n";
+            // With paced flush, write_time_sec is the hand-off to the
+            // background thread and the flush columns are the drain
+            const std::vector<double> &flush_times = writer_main.flush_times();
+            csv_file << "write_number,step,write_time_sec,data_size_mb,throughput_mb_s,cumulative_time_sec,cumulative_data_mb";
+            if (!flush_times.empty())
+            {
+                csv_file << ",flush_time_sec,flush_throughput_mb_s";
+            }
+            csv_file << "\n";
             
             double cumulative_time = 0.0;
             double cumulative_data = 0.0;
@@ -358,7 +663,13 @@ int main(int argc, char **argv)
                          << data_size_mb << ","
                          << throughput << ","
                          << cumulative_time << ","
-                         << cumulative_data << "\n";
+                         << cumulative_data;
+                if (i < flush_times.size())
+                {
+                    csv_file << "," << flush_times[i] << ","
+                             << ((flush_times[i] > 0) ? (data_size_mb / flush_times[i]) : 0.0);
+                }
+                csv_file << "\n";
             }
             csv_file.close();
             std::cout << "\n📊 Per-step throughput data saved to: " << csv_filename << std::endl;
@@ -0,0 +1,329 @@
+#include "../../gray-scott/simulation/refinement.h"
+
+#include <algorithm>
+#include <cmath>
+
+Refinement::Refinement(const Settings &settings)
+: settings(settings), size_x(0), size_y(0), size_z(0), nbx(0), nby(0), nbz(0)
+{
+}
+
+int Refinement::ratio() const { return std::max(settings.amr_ratio, 1); }
+
+void Refinement::Patch::noghost(const std::vector<double> &data,
+                                double *out) const
+{
+    for (int z = 1; z < nz + 1; z++)
+    {
+        for (int y = 1; y < ny + 1; y++)
+        {
+            const int i0 = l2i(1, y, z);
+            std::copy(&data[i0], &data[i0] + nx, out);
+            out += nx;
+        }
+    }
+}
+
+void Refinement::resize(size_t sx, size_t sy, size_t sz)
+{
+    const size_t B = std::max<size_t>(settings.brick_size, 1);
+    size_x = sx;
+    size_y = sy;
+    size_z = sz;
+    nbx = (size_x + B - 1) / B;
+    nby = (size_y + B - 1) / B;
+    nbz = (size_z + B - 1) / B;
+    patch_list.clear();
+    brick_patch.assign(nbx * nby * nbz, -1);
+}
+
+int Refinement::brick_of(int x, int y, int z) const
+{
+    if (x < 1 || x > static_cast<int>(size_x) || y < 1 ||
+        y > static_cast<int>(size_y) || z < 1 || z > static_cast<int>(size_z))
+    {
+        return -1;
+    }
+    const int B = static_cast<int>(std::max<size_t>(settings.brick_size, 1));
+    return (x - 1) / B + nbx * ((y - 1) / B + nby * ((z - 1) / B));
+}
+
+void Refinement::regrid(const double *u, const double *v)
+{
+    const int B = static_cast<int>(std::max<size_t>(settings.brick_size, 1));
+    const int r = ratio();
+    const size_t nb = nbx * nby * nbz;
+
+    // Max |grad v| of every brick, central differences in coarse cells
+    std::vector<double> grad(nb, 0.0);
+    for (int z = 1; z < static_cast<int>(size_z) + 1; z++)
+    {
+        for (int y = 1; y < static_cast<int>(size_y) + 1; y++)
+        {
+            for (int x = 1; x < static_cast<int>(size_x) + 1; x++)
+            {
+                const double gx = v[l2i(x + 1, y, z)] - v[l2i(x - 1, y, z)];
+                const double gy = v[l2i(x, y + 1, z)] - v[l2i(x, y - 1, z)];
+                const double gz = v[l2i(x, y, z + 1)] - v[l2i(x, y, z - 1)];
+                double &g = grad[brick_of(x, y, z)];
+                g = std::max(g, 0.5 * std::sqrt(gx * gx + gy * gy + gz * gz));
+            }
+        }
+    }
+
+    // Refine above the threshold, keep existing patches down to half of it
+    // so patches do not flicker, and add the face neighbors so a front does
+    // not leave the refined region before the next regrid
+    std::vector<char> flag(nb, 0);
+    for (size_t b = 0; b < nb; b++)
+    {
+        const double threshold =
+            brick_patch[b] >= 0 ? 0.5 * settings.amr_threshold
+                                : settings.amr_threshold;
+        flag[b] = grad[b] > threshold;
+    }
+    std::vector<char> refine(flag);
+    for (size_t bz = 0; bz < nbz; bz++)
+    {
+        for (size_t by = 0; by < nby; by++)
+        {
+            for (size_t bx = 0; bx < nbx; bx++)
+            {
+                const size_t b = bx + nbx * (by + nby * bz);
+                refine[b] = flag[b] || (bx > 0 && flag[b - 1]) ||
+                            (bx + 1 < nbx && flag[b + 1]) ||
+                            (by > 0 && flag[b - nbx]) ||
+                            (by + 1 < nby && flag[b + nbx]) ||
+                            (bz > 0 && flag[b - nbx * nby]) ||
+                            (bz + 1 < nbz && flag[b + nbx * nby]);
+            }
+        }
+    }
+
+    std::vector<Patch> next;
+    std::vector<int> next_patch(nb, -1);
+    for (size_t bz = 0; bz < nbz; bz++)
+    {
+        for (size_t by = 0; by < nby; by++)
+        {
+            for (size_t bx = 0; bx < nbx; bx++)
+            {
+                const size_t b = bx + nbx * (by + nby * bz);
+                if (!refine[b])
+                {
+                    continue;
+                }
+                next_patch[b] = static_cast<int>(next.size());
+                if (brick_patch[b] >= 0)
+                {
+                    // keep the fine data of a patch that stays
+                    next.push_back(std::move(patch_list[brick_patch[b]]));
+                    continue;
+                }
+
+                Patch p;
+                p.x0 = 1 + bx * B;
+                p.x1 = std::min<int>(p.x0 + B, size_x + 1);
+                p.y0 = 1 + by * B;
+                p.y1 = std::min<int>(p.y0 + B, size_y + 1);
+                p.z0 = 1 + bz * B;
+                p.z1 = std::min<int>(p.z0 + B, size_z + 1);
+                p.nx = r * (p.x1 - p.x0);
+                p.ny = r * (p.y1 - p.y0);
+                p.nz = r * (p.z1 - p.z0);
+                const size_t V = (p.nx + 2) * (p.ny + 2) * (p.nz + 2);
+                p.u.assign(V, 0.0);
+                p.v.assign(V, 0.0);
+                p.u2.assign(V, 0.0);
+                p.v2.assign(V, 0.0);
+
+                // New patches start from the coarse values
+                for (int z = 0; z < p.nz; z++)
+                {
+                    for (int y = 0; y < p.ny; y++)
+                    {
+                        for (int x = 0; x < p.nx; x++)
+                        {
+                            const int c = l2i(p.x0 + x / r, p.y0 + y / r,
+                                              p.z0 + z / r);
+                            const int i = p.l2i(x + 1, y + 1, z + 1);
+                            p.u[i] = u[c];
+                            p.v[i] = v[c];
+                        }
+                    }
+                }
+                next.push_back(std::move(p));
+            }
+        }
+    }
+    patch_list.swap(next);
+    brick_patch.swap(next_patch);
+}
+
+void Refinement::fill_ghosts(Patch &p, double theta, const double *u_old,
+                             const double *v_old, const double *u_new,
+                             const double *v_new) const
+{
+    const int r = ratio();
+
+    // (fx, fy, fz) is a ghost cell of p in its fine coordinates, 0-based
+    auto lf_fill = [&](int fx, int fy, int fz) {
+        // fine coordinates relative to the local block, may be negative
+        const int gx = (p.x0 - 1) * r + fx;
+        const int gy = (p.y0 - 1) * r + fy;
+        const int gz = (p.z0 - 1) * r + fz;
+        // coarse cell containing the fine cell, floor division
+        const int cx = (gx >= 0 ? gx / r : (gx - r + 1) / r) + 1;
+        const int cy = (gy >= 0 ? gy / r : (gy - r + 1) / r) + 1;
+        const int cz = (gz >= 0 ? gz / r : (gz - r + 1) / r) + 1;
+        const int i = p.l2i(fx + 1, fy + 1, fz + 1);
+
+        const int b = brick_of(cx, cy, cz);
+        if (b >= 0 && brick_patch[b] >= 0)
+        {
+            // the neighbor patch is at the same substep
+            const Patch &q = patch_list[brick_patch[b]];
+            const int j = q.l2i(gx - (q.x0 - 1) * r + 1,
+                                gy - (q.y0 - 1) * r + 1,
+                                gz - (q.z0 - 1) * r + 1);
+            p.u[i] = q.u[j];
+            p.v[i] = q.v[j];
+        }
+        else if (b >= 0)
+        {
+            const int c = l2i(cx, cy, cz);
+            p.u[i] = (1.0 - theta) * u_old[c] + theta * u_new[c];
+            p.v[i] = (1.0 - theta) * v_old[c] + theta * v_new[c];
+        }
+        else
+        {
+            // The ghost cells of the coarse block are only exchanged at the
+            // start of the coarse step
+            const int c = l2i(cx, cy, cz);
+            p.u[i] = u_old[c];
+            p.v[i] = v_old[c];
+        }
+    };
+
+    for (int z = 0; z < p.nz; z++)
+    {
+        for (int y = 0; y < p.ny; y++)
+        {
+            lf_fill(-1, y, z);
+            lf_fill(p.nx, y, z);
+        }
+    }
+    for (int z = 0; z < p.nz; z++)
+    {
+        for (int x = 0; x < p.nx; x++)
+        {
+            lf_fill(x, -1, z);
+            lf_fill(x, p.ny, z);
+        }
+    }
+    for (int y = 0; y < p.ny; y++)
+    {
+        for (int x = 0; x < p.nx; x++)
+        {
+            lf_fill(x, y, -1);
+            lf_fill(x, y, p.nz);
+        }
+    }
+}
+
+void Refinement::calc(Patch &p, double dt) const
+{
+    // The laplacian on the fine grid, in coarse cell units
+    const double r2 = static_cast<double>(ratio()) * ratio();
+    const int sx = 1;
+    const int sy = p.nx + 2;
+    const int sz = (p.nx + 2) * (p.ny + 2);
+
+    for (int z = 1; z < p.nz + 1; z++)
+    {
+        for (int y = 1; y < p.ny + 1; y++)
+        {
+            for (int x = 1; x < p.nx + 1; x++)
+            {
+                const int i = p.l2i(x, y, z);
+                const double tu = p.u[i];
+                const double tv = p.v[i];
+                const double lu = (p.u[i - sx] + p.u[i + sx] + p.u[i - sy] +
+                                   p.u[i + sy] + p.u[i - sz] + p.u[i + sz] -
+                                   6.0 * tu) /
+                                  6.0;
+                const double lv = (p.v[i - sx] + p.v[i + sx] + p.v[i - sy] +
+                                   p.v[i + sy] + p.v[i - sz] + p.v[i + sz] -
+                                   6.0 * tv) /
+                                  6.0;
+                const double du = settings.Du * r2 * lu - tu * tv * tv +
+                                  settings.F * (1.0 - tu);
+                const double dv = settings.Dv * r2 * lv + tu * tv * tv -
+                                  (settings.F + settings.k) * tv;
+                p.u2[i] = tu + du * dt;
+                p.v2[i] = tv + dv * dt;
+            }
+        }
+    }
+    p.u.swap(p.u2);
+    p.v.swap(p.v2);
+}
+
+void Refinement::advance(const double *u_old, const double *v_old,
+                         double *u_new, double *v_new)
+{
+    if (patch_list.empty())
+    {
+        return;
+    }
+
+    // Explicit diffusion is stable for dt / r^2 on the fine grid
+    const int r = ratio();
+    const int nsub = r * r;
+    const double dt = settings.dt / nsub;
+    for (int s = 0; s < nsub; s++)
+    {
+        const double theta = static_cast<double>(s) / nsub;
+        for (auto &p : patch_list)
+        {
+            fill_ghosts(p, theta, u_old, v_old, u_new, v_new);
+        }
+        for (auto &p : patch_list)
+        {
+            calc(p, dt);
+        }
+    }
+
+    // Restrict: coarse cell = mean of the fine cells it contains
+    const double w = 1.0 / (r * r * r);
+    for (const auto &p : patch_list)
+    {
+        for (int z = p.z0; z < p.z1; z++)
+        {
+            for (int y = p.y0; y < p.y1; y++)
+            {
+                for (int x = p.x0; x < p.x1; x++)
+                {
+                    double su = 0.0, sv = 0.0;
+                    for (int k = 0; k < r; k++)
+                    {
+                        for (int j = 0; j < r; j++)
+                        {
+                            const int i0 = p.l2i((x - p.x0) * r + 1,
+                                                 (y - p.y0) * r + j + 1,
+                                                 (z - p.z0) * r + k + 1);
+                            for (int l = 0; l < r; l++)
+                            {
+                                su += p.u[i0 + l];
+                                sv += p.v[i0 + l];
+                            }
+                        }
+                    }
+                    const int c = l2i(x, y, z);
+                    u_new[c] = su * w;
+                    v_new[c] = sv * w;
+                }
+            }
+        }
+    }
+}
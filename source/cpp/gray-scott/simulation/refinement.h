@@ -0,0 +1,78 @@
+#ifndef __REFINEMENT_H__
+#define __REFINEMENT_H__
+
+#include <vector>
+
+#include "../../gray-scott/simulation/settings.h"
+
+// One level of block-structured refinement over the local block of the
+// Gray-Scott simulation. Bricks of settings.brick_size^3 coarse cells where
+// |grad v| exceeds settings.amr_threshold are covered by patches refined
+// settings.amr_ratio times per axis. The patches take amr_ratio^2 substeps
+// per coarse step, with their ghost cells filled from neighbor patches or
+// from the coarse field interpolated in time, and are averaged back onto the
+// coarse cells they cover.
+//
+// Coarse fields are the ghosted local arrays of GrayScott,
+// (size_x + 2) * (size_y + 2) * (size_z + 2).
+class Refinement
+{
+public:
+    struct Patch
+    {
+        // Covered coarse cells in local ghosted coordinates, [x0, x1) ...
+        int x0, x1, y0, y1, z0, z1;
+        // Fine cells along each axis
+        int nx, ny, nz;
+        // Ghosted fine fields, (nx + 2) * (ny + 2) * (nz + 2)
+        std::vector<double> u, v, u2, v2;
+
+        inline int l2i(int x, int y, int z) const
+        {
+            return x + y * (nx + 2) + z * (nx + 2) * (ny + 2);
+        }
+        // Copy the fine field without ghosts to out
+        void noghost(const std::vector<double> &data, double *out) const;
+    };
+
+    Refinement(const Settings &settings);
+
+    // Drop all patches and set the size of the local block
+    void resize(size_t size_x, size_t size_y, size_t size_z);
+    // Refine and coarsen bricks from the gradient of the coarse v, which
+    // must have valid ghost cells
+    void regrid(const double *u, const double *v);
+    // Advance the patches over one coarse step from u_old/v_old to
+    // u_new/v_new, then overwrite the covered coarse cells of u_new/v_new
+    // with the averages of the fine cells
+    void advance(const double *u_old, const double *v_old, double *u_new,
+                 double *v_new);
+
+    const std::vector<Patch> &patches() const { return patch_list; }
+    // Is brick b (numbered as the active bricks of GrayScott) refined
+    bool refined(size_t b) const { return brick_patch[b] >= 0; }
+    int ratio() const;
+
+protected:
+    Settings settings;
+    size_t size_x, size_y, size_z;
+    size_t nbx, nby, nbz;
+    std::vector<Patch> patch_list;
+    // Index into patch_list of the patch covering each brick, or -1
+    std::vector<int> brick_patch;
+
+    inline int l2i(int x, int y, int z) const
+    {
+        return x + y * (size_x + 2) + z * (size_x + 2) * (size_y + 2);
+    }
+    // Brick of a local ghosted coarse cell, or -1 for ghost cells
+    int brick_of(int x, int y, int z) const;
+    // Fill the ghost cells of patch p at theta in [0, 1) of the coarse step
+    void fill_ghosts(Patch &p, double theta, const double *u_old,
+                     const double *v_old, const double *u_new,
+                     const double *v_new) const;
+    // One substep of the fine stencil on patch p
+    void calc(Patch &p, double dt) const;
+};
+
+#endif
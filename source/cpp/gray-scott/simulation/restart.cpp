@@ -1,6 +1,10 @@
 #include "../../gray-scott/simulation/restart.h"
 
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
 #include <iostream>
+#include <stdexcept>
 
 static bool firstCkpt = true;
 
@@ -13,27 +17,46 @@ void WriteCkpt(MPI_Comm comm, const int step, const Settings &settings,
     std::cout << "checkpoint at step " << step << " create file "
               << settings.checkpoint_output << std::endl;
     adios2::Engine writer =
-        io.Open(settings.checkpoint_output, adios2::Mode::Write);
+        io.Open(settings.checkpoint_output, adios2::Mode::Write, comm);
     if (writer)
     {
         adios2::Variable<double> var_u;
         adios2::Variable<double> var_v;
         adios2::Variable<int> var_step;
+        adios2::Variable<uint64_t> var_decomp[3];
+        const std::vector<size_t> *bounds[3] = {&sim.bounds_x, &sim.bounds_y,
+                                                &sim.bounds_z};
+        const char *decomp_names[3] = {"decomp_x", "decomp_y", "decomp_z"};
+
+        size_t X = sim.size_x + 2;
+        size_t Y = sim.size_y + 2;
+        size_t Z = sim.size_z + 2;
+        size_t R = static_cast<size_t>(rank);
+        size_t N = static_cast<size_t>(nproc);
+
+        // The blocks differ in size after the simulation rebalances, the
+        // shape holds the largest of them
+        unsigned long long block[3] = {X, Y, Z};
+        MPI_Allreduce(MPI_IN_PLACE, block, 3, MPI_UNSIGNED_LONG_LONG, MPI_MAX,
+                      comm);
+        const adios2::Dims shape = {N, static_cast<size_t>(block[0]),
+                                    static_cast<size_t>(block[1]),
+                                    static_cast<size_t>(block[2])};
 
         if (firstCkpt)
         {
-            size_t X = sim.size_x + 2;
-            size_t Y = sim.size_y + 2;
-            size_t Z = sim.size_z + 2;
-            size_t R = static_cast<size_t>(rank);
-            size_t N = static_cast<size_t>(nproc);
-
-            var_u = io.DefineVariable<double>("U", {N, X, Y, Z}, {R, 0, 0, 0},
-                                            {1, X, Y, Z});
-            var_v = io.DefineVariable<double>("V", {N, X, Y, Z}, {R, 0, 0, 0},
-                                            {1, X, Y, Z});
+            var_u = io.DefineVariable<double>("U", shape, {R, 0, 0, 0},
+                                              {1, X, Y, Z});
+            var_v = io.DefineVariable<double>("V", shape, {R, 0, 0, 0},
+                                              {1, X, Y, Z});
 
             var_step = io.DefineVariable<int>("step");
+            for (int d = 0; d < 3; d++)
+            {
+                const size_t n = bounds[d]->size();
+                var_decomp[d] = io.DefineVariable<uint64_t>(decomp_names[d],
+                                                            {n}, {0}, {n});
+            }
             firstCkpt = false;
         }
         else
@@ -41,19 +64,162 @@ void WriteCkpt(MPI_Comm comm, const int step, const Settings &settings,
             var_u = io.InquireVariable<double>("U");
             var_v = io.InquireVariable<double>("V");
             var_step = io.InquireVariable<int>("step");
+            for (int d = 0; d < 3; d++)
+            {
+                var_decomp[d] = io.InquireVariable<uint64_t>(decomp_names[d]);
+            }
+            // the block size changes when the simulation rebalances
+            var_u.SetShape(shape);
+            var_u.SetSelection({{R, 0, 0, 0}, {1, X, Y, Z}});
+            var_v.SetShape(shape);
+            var_v.SetSelection({{R, 0, 0, 0}, {1, X, Y, Z}});
         }
 
         writer.Put<int>(var_step, &step);
         writer.Put<double>(var_u, sim.u_ghost().data());
         writer.Put<double>(var_v, sim.v_ghost().data());
+        // block boundaries, so a restart can continue with the same blocks
+        std::vector<uint64_t> decomp[3];
+        if (!rank)
+        {
+            for (int d = 0; d < 3; d++)
+            {
+                decomp[d].assign(bounds[d]->begin(), bounds[d]->end());
+                writer.Put<uint64_t>(var_decomp[d], decomp[d].data());
+            }
+        }
 
         writer.Close();
     }
 }
 
+// Output steps of the file that hold blocks of var, in order
+static std::vector<size_t> StepsWith(adios2::Engine &reader,
+                                     const adios2::Variable<double> &var)
+{
+    std::vector<size_t> steps;
+    for (const auto &s : reader.AllStepsBlocksInfo(var))
+    {
+        if (!s.second.empty())
+        {
+            steps.push_back(s.first);
+        }
+    }
+    return steps;
+}
+
+// Restart from the interior U and V of a regular output step. The output is
+// uncompressed double precision, so the fields are those of the checkpoint
+// but for the ghost cells, which one exchange restores. Any decomposition
+// can read any box of it.
+static int ReadRestartOutput(MPI_Comm comm, const Settings &settings,
+                             GrayScott &sim, adios2::IO io)
+{
+    int step = 0;
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    adios2::Engine reader =
+        io.Open(settings.restart_input, adios2::Mode::ReadRandomAccess,
+                comm);
+    if (!reader)
+    {
+        std::cout << "    failed to open file " << std::endl;
+        return step;
+    }
+
+    adios2::Variable<int> var_step = io.InquireVariable<int>("step");
+    adios2::Variable<double> var_u = io.InquireVariable<double>("U");
+    adios2::Variable<double> var_v = io.InquireVariable<double>("V");
+    if (!var_step || !var_u || !var_v)
+    {
+        throw std::runtime_error("Restart input " + settings.restart_input +
+                                 " has no U, V and step");
+    }
+
+    // With output_u_every or output_v_every only some output steps hold U
+    // or V, the restart step needs both. Steps of a variable are counted
+    // over the steps that have it.
+    const size_t steps = var_step.Steps();
+    const std::vector<size_t> u_steps = StepsWith(reader, var_u);
+    const std::vector<size_t> v_steps = StepsWith(reader, var_v);
+    auto has_both = [&](size_t s) {
+        return std::binary_search(u_steps.begin(), u_steps.end(), s) &&
+               std::binary_search(v_steps.begin(), v_steps.end(), s);
+    };
+    size_t s = static_cast<size_t>(settings.restart_output_step);
+    if (settings.restart_output_step < 0)
+    {
+        s = steps;
+        for (size_t i = steps; i-- > 0;)
+        {
+            if (has_both(i))
+            {
+                s = i;
+                break;
+            }
+        }
+    }
+    if (s >= steps || !has_both(s))
+    {
+        throw std::runtime_error(
+            "Restart input " + settings.restart_input + " has " +
+            std::to_string(steps) +
+            " output steps, cannot restart from " +
+            std::to_string(settings.restart_output_step) +
+            ", which needs an output step with U and V");
+    }
+    const size_t s_u =
+        std::lower_bound(u_steps.begin(), u_steps.end(), s) - u_steps.begin();
+    const size_t s_v =
+        std::lower_bound(v_steps.begin(), v_steps.end(), s) - v_steps.begin();
+    if (!rank)
+    {
+        std::cout << "restart from output step " << s << " of file "
+                  << settings.restart_input << std::endl;
+    }
+
+    // Ensemble outputs have the member in front
+    adios2::Box<adios2::Dims> box = {
+        {sim.offset_z, sim.offset_y, sim.offset_x},
+        {sim.size_z, sim.size_y, sim.size_x}};
+    if (settings.members() > 1)
+    {
+        box.first.insert(box.first.begin(), settings.member);
+        box.second.insert(box.second.begin(), 1);
+    }
+
+    std::vector<double> u, v;
+    var_step.SetStepSelection({s, 1});
+    var_u.SetStepSelection({s_u, 1});
+    var_v.SetStepSelection({s_v, 1});
+    var_u.SetSelection(box);
+    var_v.SetSelection(box);
+    reader.Get<int>(var_step, step);
+    if (sim.size_x && sim.size_y && sim.size_z)
+    {
+        reader.Get<double>(var_u, u);
+        reader.Get<double>(var_v, v);
+    }
+    reader.Close();
+
+    if (!rank)
+    {
+        std::cout << "restart from step " << step << std::endl;
+    }
+    u.resize(sim.size_x * sim.size_y * sim.size_z);
+    v.resize(sim.size_x * sim.size_y * sim.size_z);
+    sim.restart_noghost(u, v);
+    return step;
+}
+
 int ReadRestart(MPI_Comm comm, const Settings &settings, GrayScott &sim,
                 adios2::IO io)
 {
+    if (settings.restart_from_output)
+    {
+        return ReadRestartOutput(comm, settings, sim, io);
+    }
+
     int step = 0;
     int rank, nproc;
     MPI_Comm_rank(comm, &rank);
@@ -63,12 +229,34 @@ int ReadRestart(MPI_Comm comm, const Settings &settings, GrayScott &sim,
         std::cout << "restart from file " << settings.restart_input << std::endl;
     }
     adios2::Engine reader =
-        io.Open(settings.restart_input, adios2::Mode::ReadRandomAccess);
+        io.Open(settings.restart_input, adios2::Mode::ReadRandomAccess,
+                comm);
     if (reader)
     {
         adios2::Variable<int> var_step = io.InquireVariable<int>("step");
         adios2::Variable<double> var_u = io.InquireVariable<double>("U");
         adios2::Variable<double> var_v = io.InquireVariable<double>("V");
+        // Checkpoints written after rebalancing carry the block boundaries
+        const char *decomp_names[3] = {"decomp_x", "decomp_y", "decomp_z"};
+        std::vector<uint64_t> decomp[3];
+        for (int d = 0; d < 3; d++)
+        {
+            adios2::Variable<uint64_t> var_decomp =
+                io.InquireVariable<uint64_t>(decomp_names[d]);
+            if (var_decomp)
+            {
+                reader.Get<uint64_t>(var_decomp, decomp[d],
+                                     adios2::Mode::Sync);
+            }
+        }
+        if (!decomp[0].empty() && !decomp[1].empty() && !decomp[2].empty())
+        {
+            sim.set_decomposition(
+                std::vector<size_t>(decomp[0].begin(), decomp[0].end()),
+                std::vector<size_t>(decomp[1].begin(), decomp[1].end()),
+                std::vector<size_t>(decomp[2].begin(), decomp[2].end()));
+        }
+
         size_t X = sim.size_x + 2;
         size_t Y = sim.size_y + 2;
         size_t Z = sim.size_z + 2;
@@ -94,3 +282,84 @@ int ReadRestart(MPI_Comm comm, const Settings &settings, GrayScott &sim,
     }
     return step;
 }
+
+CheckpointScheduler::CheckpointScheduler(const Settings &settings,
+                                         MPI_Comm comm)
+: settings(settings), comm(comm), last(std::chrono::steady_clock::now())
+{
+    MPI_Comm_rank(comm, &rank);
+}
+
+bool CheckpointScheduler::due(int step)
+{
+    if (settings.checkpoint_mtbf <= 0.0 || tau <= 0.0)
+    {
+        return (step % settings.checkpoint_freq) == 0;
+    }
+
+    // Clocks differ between ranks, rank 0 decides for everyone
+    int flag = 0;
+    if (!rank)
+    {
+        const double elapsed = std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() - last)
+                                   .count();
+        flag = elapsed >= tau;
+    }
+    MPI_Bcast(&flag, 1, MPI_INT, 0, comm);
+    return flag != 0;
+}
+
+void CheckpointScheduler::written(double seconds)
+{
+    // The checkpoint costs everyone the time of the slowest writer
+    double c = 0.0;
+    MPI_Allreduce(&seconds, &c, 1, MPI_DOUBLE, MPI_MAX, comm);
+    total_cost += c;
+    C = checkpoints ? 0.5 * (C + c) : c;
+    checkpoints++;
+
+    // Daly's higher order estimate of the optimum compute time between
+    // checkpoints, sqrt(2 C M) - C to first order (Young)
+    const double M = settings.checkpoint_mtbf;
+    if (M > 0.0)
+    {
+        if (C < 2.0 * M)
+        {
+            const double r = C / (2.0 * M);
+            tau = std::sqrt(2.0 * C * M) * (1.0 + std::sqrt(r) / 3.0 + r / 9.0) -
+                  C;
+        }
+        else
+        {
+            tau = M;
+        }
+    }
+    last = std::chrono::steady_clock::now();
+}
+
+void CheckpointScheduler::print_summary(double run_time) const
+{
+    const double M = settings.checkpoint_mtbf;
+    if (M <= 0.0 || run_time <= 0.0)
+    {
+        return;
+    }
+
+    // On average a failure loses half an interval of work and the
+    // checkpoint in progress
+    const double failures = run_time / M;
+    const double lost = failures * 0.5 * (tau + C);
+    std::cout << std::fixed << std::setprecision(4)
+              << "\nCheckpoint interval (Young/Daly):"
+              << "\n  MTBF:                   " << M << " seconds"
+              << "\n  Checkpoint cost:        " << C << " seconds"
+              << "\n  Interval:               " << tau << " seconds"
+              << "\n  Checkpoint overhead:    " << total_cost << " seconds ("
+              << std::setprecision(2) << total_cost / run_time * 100 << "%)"
+              << std::setprecision(4)
+              << "\n  Expected failures:      " << failures
+              << "\n  Expected lost work:     " << lost << " seconds ("
+              << std::setprecision(2) << lost / run_time * 100 << "%)"
+              << std::setprecision(4) << std::endl;
+}
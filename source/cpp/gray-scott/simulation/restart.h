@@ -4,6 +4,8 @@
 #include "../../gray-scott/simulation/gray-scott.h"
 #include "../../gray-scott/simulation/settings.h"
 
+#include <chrono>
+
 #include <adios2.h>
 #include <mpi.h>
 
@@ -12,4 +14,39 @@ void WriteCkpt(MPI_Comm comm, const int step, const Settings &settings,
 int ReadRestart(MPI_Comm comm, const Settings &settings, GrayScott &sim,
                 adios2::IO io);
 
+// Decides after which steps to checkpoint. Without settings.checkpoint_mtbf
+// that is every checkpoint_freq steps. With it, the first checkpoint is taken
+// at checkpoint_freq steps to measure its cost C, and every later one once
+// the wall-clock time since the end of the previous one reaches Daly's
+// optimum interval for C and the MTBF. C is re-estimated after every
+// checkpoint, so the interval follows the file system.
+class CheckpointScheduler
+{
+public:
+    CheckpointScheduler(const Settings &settings, MPI_Comm comm);
+
+    // Checkpoint after this step? The same answer on every rank of comm.
+    bool due(int step);
+    // Seconds this rank spent writing the checkpoint due() asked for
+    void written(double seconds);
+
+    // Estimated checkpoint cost and current interval in seconds, 0 before
+    // the first checkpoint
+    double cost() const { return C; }
+    double interval() const { return tau; }
+    // Expected lost work against checkpoint overhead over a run of run_time
+    // seconds, printed on the calling rank
+    void print_summary(double run_time) const;
+
+protected:
+    Settings settings;
+    MPI_Comm comm;
+    int rank;
+    double C = 0.0;
+    double tau = 0.0;
+    double total_cost = 0.0;
+    int checkpoints = 0;
+    std::chrono::steady_clock::time_point last;
+};
+
 #endif
@@ -1,6 +1,8 @@
 #include "../../gray-scott/simulation/settings.h"
 
 #include <fstream>
+#include <sstream>
+#include <stdexcept>
 
 #include "../../gray-scott/simulation/json.hpp"
 
@@ -16,15 +18,55 @@ void to_json(nlohmann::json &j, const Settings &s)
                        {"Dv", s.Dv},
                        {"noise", s.noise},
                        {"output", s.output},
+                       {"output_u_every", s.output_u_every},
+                       {"output_v_every", s.output_v_every},
+                       {"output_rollover_steps", s.output_rollover_steps},
+                       {"output_rollover_gb", s.output_rollover_gb},
+                       {"output_alignment", s.output_alignment},
+                       {"direct_io_block", s.direct_io_block},
+                       {"paced_flush", s.paced_flush},
+                       {"paced_flush_chunks", s.paced_flush_chunks},
                        {"checkpoint", s.checkpoint},
                        {"checkpoint_freq", s.checkpoint_freq},
                        {"checkpoint_output", s.checkpoint_output},
+                       {"checkpoint_mtbf", s.checkpoint_mtbf},
                        {"restart", s.restart},
                        {"restart_input", s.restart_input},
+                       {"restart_from_output", s.restart_from_output},
+                       {"restart_output_step", s.restart_output_step},
                        {"adios_config", s.adios_config},
                        {"adios_span", s.adios_span},
                        {"adios_memory_selection", s.adios_memory_selection},
-                       {"mesh_type", s.mesh_type}};
+                       {"mesh_type", s.mesh_type},
+                       {"active_bricks", s.active_bricks},
+                       {"brick_size", s.brick_size},
+                       {"active_tolerance", s.active_tolerance},
+                       {"rebalance_interval", s.rebalance_interval},
+                       {"rebalance_threshold", s.rebalance_threshold},
+                       {"amr", s.amr},
+                       {"amr_ratio", s.amr_ratio},
+                       {"amr_threshold", s.amr_threshold},
+                       {"amr_interval", s.amr_interval},
+                       {"integrator", s.integrator},
+                       {"dt_tolerance", s.dt_tolerance},
+                       {"dt_max", s.dt_max},
+                       {"cg_tolerance", s.cg_tolerance},
+                       {"cg_max_iterations", s.cg_max_iterations},
+                       {"ensemble_batch", s.ensemble_batch},
+                       {"in_place", s.in_place},
+                       {"io_ranks_per_node", s.io_ranks_per_node}};
+    for (size_t m = 0; m < s.ensemble_F.size(); m++)
+    {
+        j["ensemble"].push_back(
+            {{"F", s.ensemble_F[m]}, {"k", s.ensemble_k[m]}});
+    }
+    const char *axes = "xyz";
+    for (size_t i = 0; i < s.slice_axis.size(); i++)
+    {
+        j["output_slices"].push_back(
+            {{"axis", std::string(1, axes[s.slice_axis[i]])},
+             {"index", s.slice_index[i]}});
+    }
 }
 
 void from_json(const nlohmann::json &j, Settings &s)
@@ -48,6 +90,81 @@ void from_json(const nlohmann::json &j, Settings &s)
     j.at("adios_span").get_to(s.adios_span);
     j.at("adios_memory_selection").get_to(s.adios_memory_selection);
     j.at("mesh_type").get_to(s.mesh_type);
+
+    // optional keys, the defaults come from Settings()
+    s.output_u_every = j.value("output_u_every", s.output_u_every);
+    s.output_v_every = j.value("output_v_every", s.output_v_every);
+    s.output_rollover_steps =
+        j.value("output_rollover_steps", s.output_rollover_steps);
+    s.output_rollover_gb = j.value("output_rollover_gb", s.output_rollover_gb);
+    s.output_alignment = j.value("output_alignment", s.output_alignment);
+    s.direct_io_block = j.value("direct_io_block", s.direct_io_block);
+    s.paced_flush = j.value("paced_flush", s.paced_flush);
+    s.paced_flush_chunks =
+        j.value("paced_flush_chunks", s.paced_flush_chunks);
+    s.checkpoint_mtbf = j.value("checkpoint_mtbf", s.checkpoint_mtbf);
+    s.restart_from_output =
+        j.value("restart_from_output", s.restart_from_output);
+    s.restart_output_step =
+        j.value("restart_output_step", s.restart_output_step);
+    s.active_bricks = j.value("active_bricks", s.active_bricks);
+    s.brick_size = j.value("brick_size", s.brick_size);
+    s.active_tolerance = j.value("active_tolerance", s.active_tolerance);
+    s.rebalance_interval = j.value("rebalance_interval", s.rebalance_interval);
+    s.rebalance_threshold =
+        j.value("rebalance_threshold", s.rebalance_threshold);
+    s.amr = j.value("amr", s.amr);
+    s.amr_ratio = j.value("amr_ratio", s.amr_ratio);
+    s.amr_threshold = j.value("amr_threshold", s.amr_threshold);
+    s.amr_interval = j.value("amr_interval", s.amr_interval);
+    if (s.amr_interval < 1 || s.amr_ratio < 2)
+    {
+        throw std::invalid_argument(
+            "ERROR: amr_interval needs to be at least 1 and amr_ratio at "
+            "least 2\n");
+    }
+    s.integrator = j.value("integrator", s.integrator);
+    if (s.integrator != "euler" && s.integrator != "imex")
+    {
+        throw std::invalid_argument(
+            "ERROR: integrator needs to be \"euler\" or \"imex\"\n");
+    }
+    s.dt_tolerance = j.value("dt_tolerance", s.dt_tolerance);
+    s.dt_max = j.value("dt_max", s.dt_max);
+    s.cg_tolerance = j.value("cg_tolerance", s.cg_tolerance);
+    s.cg_max_iterations = j.value("cg_max_iterations", s.cg_max_iterations);
+    s.ensemble_batch = j.value("ensemble_batch", s.ensemble_batch);
+    s.in_place = j.value("in_place", s.in_place);
+    s.io_ranks_per_node = j.value("io_ranks_per_node", s.io_ranks_per_node);
+
+    // "ensemble": [{"F": ..., "k": ...}, ...], a missing F or k is taken
+    // from the top level
+    if (j.count("ensemble"))
+    {
+        for (const auto &m : j.at("ensemble"))
+        {
+            s.ensemble_F.push_back(m.value("F", s.F));
+            s.ensemble_k.push_back(m.value("k", s.k));
+        }
+    }
+
+    // "output_slices": [{"axis": "z", "index": 32}, ...]
+    if (j.count("output_slices"))
+    {
+        for (const auto &p : j.at("output_slices"))
+        {
+            const std::string axis = p.at("axis").get<std::string>();
+            const size_t index = p.at("index").get<size_t>();
+            if ((axis != "x" && axis != "y" && axis != "z") || index >= s.L)
+            {
+                throw std::invalid_argument(
+                    "ERROR: output_slices entries need an axis x, y or z "
+                    "and an index below L\n");
+            }
+            s.slice_axis.push_back(axis[0] - 'x');
+            s.slice_index.push_back(index);
+        }
+    }
 }
 
 Settings::Settings()
@@ -62,15 +179,88 @@ Settings::Settings()
     Dv = 0.1;
     noise = 0.0;
     output = "foo.bp";
+    output_u_every = 1;
+    output_v_every = 1;
+    output_rollover_steps = 0;
+    output_rollover_gb = 0.0;
+    output_alignment = 0;
+    direct_io_block = 0;
+    paced_flush = false;
+    paced_flush_chunks = 8;
     checkpoint = false;
     checkpoint_freq = 2000;
     checkpoint_output = "ckpt.bp";
+    checkpoint_mtbf = 0.0;
     restart = false;
     restart_input = "ckpt.bp";
+    restart_from_output = false;
+    restart_output_step = -1;
     adios_config = "adios2.xml";
     adios_span = false;
     adios_memory_selection = false;
     mesh_type = "image";
+    active_bricks = false;
+    brick_size = 16;
+    active_tolerance = 1.0e-9;
+    rebalance_interval = 0;
+    rebalance_threshold = 1.1;
+    amr = false;
+    amr_ratio = 2;
+    amr_threshold = 0.05;
+    amr_interval = 10;
+    integrator = "euler";
+    dt_tolerance = 0.0;
+    dt_max = 0.0;
+    cg_tolerance = 1.0e-8;
+    cg_max_iterations = 200;
+    member = 0;
+    ensemble_batch = 1;
+    in_place = false;
+    io_ranks_per_node = 0;
+}
+
+int Settings::members() const
+{
+    return ensemble_F.empty() ? 1 : static_cast<int>(ensemble_F.size());
+}
+
+bool Settings::output_u_at(int step) const
+{
+    return output_u_every > 0 && (step / plotgap) % output_u_every == 0;
+}
+
+bool Settings::output_v_at(int step) const
+{
+    return output_v_every > 0 && (step / plotgap) % output_v_every == 0;
+}
+
+Settings Settings::for_member(int m) const
+{
+    // name.bp -> name-member<m>.bp
+    auto lf_name = [m](const std::string &name) {
+        const std::string tag = "-member" + std::to_string(m);
+        const size_t dot = name.rfind('.');
+        if (dot == std::string::npos || dot == 0)
+        {
+            return name + tag;
+        }
+        return name.substr(0, dot) + tag + name.substr(dot);
+    };
+
+    Settings s(*this);
+    s.member = m;
+    if (!ensemble_F.empty())
+    {
+        s.F = ensemble_F[m];
+        s.k = ensemble_k[m];
+        s.checkpoint_output = lf_name(checkpoint_output);
+        // All members share one output
+        if (!restart_from_output)
+        {
+            s.restart_input = lf_name(restart_input);
+        }
+    }
+    return s;
 }
 
 Settings Settings::from_json(const std::string &fname)
@@ -82,3 +272,27 @@ Settings Settings::from_json(const std::string &fname)
 
     return j.get<Settings>();
 }
+
+Settings Settings::from_json(const std::string &fname, MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    // Only rank 0 touches the (shared) filesystem, at scale every rank
+    // opening the same small file is a metadata storm
+    std::string contents;
+    unsigned long long len = 0;
+    if (rank == 0)
+    {
+        std::ifstream ifs(fname);
+        std::ostringstream ss;
+        ss << ifs.rdbuf();
+        contents = ss.str();
+        len = contents.size();
+    }
+    MPI_Bcast(&len, 1, MPI_UNSIGNED_LONG_LONG, 0, comm);
+    contents.resize(len);
+    MPI_Bcast(&contents[0], static_cast<int>(len), MPI_CHAR, 0, comm);
+
+    return nlohmann::json::parse(contents).get<Settings>();
+}
@@ -2,6 +2,9 @@
 #define __SETTINGS_H__
 
 #include <string>
+#include <vector>
+
+#include <mpi.h>
 
 struct Settings
 {
@@ -15,18 +18,92 @@ struct Settings
     double Dv;
     double noise;
     std::string output;
+    // Write U and V every output_u_every and output_v_every output steps
+    // (0 = never), step goes with every output step
+    int output_u_every;
+    int output_v_every;
+    // Axis-aligned planes written as 2D arrays with every output step: axis
+    // (0, 1, 2 for x, y, z) and global index along it of each
+    std::vector<int> slice_axis;
+    std::vector<size_t> slice_index;
+    // Start a new output file every output_rollover_steps steps or
+    // output_rollover_gb GB, whichever comes first (0 = never)
+    int output_rollover_steps;
+    double output_rollover_gb;
+    // Storage stripe or object size in bytes the subfile writes of the
+    // output are aligned to (0 = as configured in adios_config)
+    size_t output_alignment;
+    // Write the output with O_DIRECT in blocks of this many bytes, from
+    // staging buffers aligned to them (0 = through the page cache)
+    size_t direct_io_block;
+    // Drain each output step in the background in paced_flush_chunks parts
+    // spread over the time to the next output step
+    bool paced_flush;
+    int paced_flush_chunks;
     bool checkpoint;
     int checkpoint_freq;
     std::string checkpoint_output;
+    // Mean time between failures in seconds. When set, checkpoints are
+    // written at the Young/Daly interval from the measured checkpoint cost
+    // instead of every checkpoint_freq steps.
+    double checkpoint_mtbf;
     bool restart;
     std::string restart_input;
+    // restart_input is a simulation output instead of a checkpoint, restart
+    // from its output step restart_output_step (-1 for the last one)
+    bool restart_from_output;
+    int restart_output_step;
     std::string adios_config;
     bool adios_span;
     bool adios_memory_selection;
     std::string mesh_type;
+    // Skip the stencil on bricks that sit at the u=1, v=0 steady state
+    bool active_bricks;
+    size_t brick_size;
+    double active_tolerance;
+    // Re-split the domain every rebalance_interval steps (0 = never) if the
+    // slowest rank is rebalance_threshold times slower than the average
+    int rebalance_interval;
+    double rebalance_threshold;
+    // Refine bricks where |grad v| exceeds amr_threshold by amr_ratio,
+    // re-evaluated every amr_interval steps
+    bool amr;
+    int amr_ratio;
+    double amr_threshold;
+    int amr_interval;
+    // "euler" (explicit) or "imex" (implicit diffusion, explicit reaction).
+    // With dt_tolerance > 0 imex adapts dt to keep the local error of the
+    // reaction term below it, up to dt_max if set.
+    std::string integrator;
+    double dt_tolerance;
+    double dt_max;
+    double cg_tolerance;
+    int cg_max_iterations;
+    // Update u/v in place with a rolling window of saved planes instead of
+    // double buffering, explicit steps without active bricks or amr only
+    bool in_place;
+    // Ensemble run: F and k of every member, empty for a single simulation,
+    // and the member this process belongs to
+    std::vector<double> ensemble_F;
+    std::vector<double> ensemble_k;
+    int member;
+    // Members advanced together by one group of processes
+    int ensemble_batch;
+    // Ranks per node taken out of the simulation to write the output of the
+    // others, 0 to write from the compute ranks
+    int io_ranks_per_node;
 
     Settings();
     static Settings from_json(const std::string &fname);
+    // Rank 0 reads the file and broadcasts its contents to the other ranks
+    static Settings from_json(const std::string &fname, MPI_Comm comm);
+    // Number of ensemble members, 1 for a single simulation
+    int members() const;
+    // Whether U and V are in the output of simulation step step
+    bool output_u_at(int step) const;
+    bool output_v_at(int step) const;
+    // Settings of ensemble member m, with its own checkpoint files
+    Settings for_member(int m) const;
 };
 
 #endif
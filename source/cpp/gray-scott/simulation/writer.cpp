@@ -1,5 +1,13 @@
 #include "../../gray-scott/simulation/writer.h"
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <new>
+
 void define_bpvtk_attribute(const Settings &s, adios2::IO &io)
 {
     auto lf_VTKImage = [](const Settings &s, adios2::IO &io) {
@@ -41,112 +49,782 @@ void define_bpvtk_attribute(const Settings &s, adios2::IO &io)
     // TODO extend to other formats e.g. structured
 }
 
-Writer::Writer(const Settings &settings, const GrayScott &sim, adios2::IO io)
-: settings(settings), io(io)
+template <class Sim>
+void Writer::define_variables(const Sim &sim, size_t count, bool ghosted)
 {
-    io.DefineAttribute<double>("F", settings.F);
-    io.DefineAttribute<double>("k", settings.k);
+    if (settings.members() > 1)
+    {
+        // U and V get a leading member dimension, member m ran F[m], k[m]
+        io.DefineAttribute<double>("F", settings.ensemble_F.data(),
+                                   settings.ensemble_F.size());
+        io.DefineAttribute<double>("k", settings.ensemble_k.data(),
+                                   settings.ensemble_k.size());
+    }
+    else
+    {
+        io.DefineAttribute<double>("F", settings.F);
+        io.DefineAttribute<double>("k", settings.k);
+    }
     io.DefineAttribute<double>("dt", settings.dt);
     io.DefineAttribute<double>("Du", settings.Du);
     io.DefineAttribute<double>("Dv", settings.Dv);
     io.DefineAttribute<double>("noise", settings.noise);
-    // define VTK visualization schema as an attribute
-    if (!settings.mesh_type.empty())
+    // define VTK visualization schema as an attribute, the visualization
+    // schemas describe a single 3D field and are left out of ensemble runs
+    if (!settings.mesh_type.empty() && settings.members() == 1)
     {
         define_bpvtk_attribute(settings, io);
     }
 
     // add attributes for Fides
-    io.DefineAttribute<std::string>("Fides_Data_Model", "uniform");
-    double origin[3] = {0.0, 0.0, 0.0};
-    io.DefineAttribute<double>("Fides_Origin", &origin[0], 3);
-    double spacing[3] = {0.1, 0.1, 0.1};
-    io.DefineAttribute<double>("Fides_Spacing", &spacing[0], 3);
-    io.DefineAttribute<std::string>("Fides_Dimension_Variable", "U");
-
-    std::vector<std::string> varList = {"U", "V"};
-    std::vector<std::string> assocList = {"points", "points"};
-    io.DefineAttribute<std::string>("Fides_Variable_List", varList.data(), varList.size());
-    io.DefineAttribute<std::string>("Fides_Variable_Associations", assocList.data(), assocList.size());
-
-    var_u =
-        io.DefineVariable<double>("U", {settings.L, settings.L, settings.L},
-                                  {sim.offset_z, sim.offset_y, sim.offset_x},
-                                  {sim.size_z, sim.size_y, sim.size_x});
-
-    var_v =
-        io.DefineVariable<double>("V", {settings.L, settings.L, settings.L},
-                                  {sim.offset_z, sim.offset_y, sim.offset_x},
-                                  {sim.size_z, sim.size_y, sim.size_x});
+    if (settings.members() == 1)
+    {
+        io.DefineAttribute<std::string>("Fides_Data_Model", "uniform");
+        double origin[3] = {0.0, 0.0, 0.0};
+        io.DefineAttribute<double>("Fides_Origin", &origin[0], 3);
+        double spacing[3] = {0.1, 0.1, 0.1};
+        io.DefineAttribute<double>("Fides_Spacing", &spacing[0], 3);
+        io.DefineAttribute<std::string>("Fides_Dimension_Variable", "U");
 
-    if (settings.adios_memory_selection)
+        std::vector<std::string> varList = {"U", "V"};
+        std::vector<std::string> assocList = {"points", "points"};
+        io.DefineAttribute<std::string>("Fides_Variable_List", varList.data(), varList.size());
+        io.DefineAttribute<std::string>("Fides_Variable_Associations", assocList.data(), assocList.size());
+    }
+
+    var_u = io.DefineVariable<double>(
+        "U", dims(settings.L, settings.L, settings.L, settings.members()),
+        dims(sim.offset_z, sim.offset_y, sim.offset_x, settings.member),
+        dims(sim.size_z, sim.size_y, sim.size_x, count));
+
+    var_v = io.DefineVariable<double>(
+        "V", dims(settings.L, settings.L, settings.L, settings.members()),
+        dims(sim.offset_z, sim.offset_y, sim.offset_x, settings.member),
+        dims(sim.size_z, sim.size_y, sim.size_x, count));
+
+    if (settings.adios_memory_selection && ghosted)
     {
         var_u.SetMemorySelection(
-            {{1, 1, 1}, {sim.size_z + 2, sim.size_y + 2, sim.size_x + 2}});
+            {dims(1, 1, 1, 0),
+             dims(sim.size_z + 2, sim.size_y + 2, sim.size_x + 2, count)});
         var_v.SetMemorySelection(
-            {{1, 1, 1}, {sim.size_z + 2, sim.size_y + 2, sim.size_x + 2}});
+            {dims(1, 1, 1, 0),
+             dims(sim.size_z + 2, sim.size_y + 2, sim.size_x + 2, count)});
     }
 
     var_step = io.DefineVariable<int>("step");
 }
 
-void Writer::open(const std::string &fname, bool append)
+Writer::Writer(const Settings &settings, const GrayScott &sim, adios2::IO io)
+: settings(settings), io(io)
 {
+    define_variables(sim, 1, true);
+
+    // U/slice_z32 is the plane z = 32 of U, a global {L, L} array (with the
+    // member in front in ensembles). Selections are set per step.
+    for (size_t i = 0; i < settings.slice_axis.size(); i++)
+    {
+        const int axis = settings.slice_axis[i];
+        const std::string name = std::string("slice_") + "xyz"[axis] +
+                                 std::to_string(settings.slice_index[i]);
+        adios2::Dims shape = {settings.L, settings.L};
+        if (settings.members() > 1)
+        {
+            shape.insert(shape.begin(), settings.members());
+        }
+        const adios2::Dims zero(shape.size(), 0);
+        slices_u.push_back({axis, settings.slice_index[i], {}});
+        slices_v.push_back({axis, settings.slice_index[i], {}});
+        var_u_slices.push_back(
+            io.DefineVariable<double>("U/" + name, shape, zero, zero));
+        var_v_slices.push_back(
+            io.DefineVariable<double>("V/" + name, shape, zero, zero));
+    }
+
+    if (settings.amr)
+    {
+        var_u_fine = io.DefineVariable<double>("U_fine", {}, {}, {1, 1, 1});
+        var_v_fine = io.DefineVariable<double>("V_fine", {}, {}, {1, 1, 1});
+        var_fine_boxes =
+            io.DefineVariable<uint64_t>("fine_boxes", {}, {}, {1, 6});
+        io.DefineAttribute<int>("refinement_ratio",
+                                sim.refinement().ratio());
+    }
+}
+
+Writer::Writer(const Settings &settings, const GrayScottBatch &sim,
+               adios2::IO io)
+: settings(settings), io(io)
+{
+    // Members are staged without ghosts, adios_memory_selection does not
+    // apply
+    define_variables(sim, sim.members(), false);
+}
+
+Writer::Writer(const Settings &settings, adios2::IO io)
+: settings(settings), io(io)
+{
+    // The selection is set per block in write(), the blocks arrive without
+    // ghosts
+    define_variables(Block(), 1, false);
+}
+
+void Writer::open(const std::string &fname, int restart_step, MPI_Comm comm)
+{
+    const bool append = restart_step > 0;
+    this->fname = fname;
+    this->comm = comm;
+    if (settings.output_alignment)
+    {
+        align_subfiles();
+    }
+    paced = false;
+    if (settings.paced_flush)
+    {
+        // The background thread does MPI in the engine while the
+        // simulation exchanges halos. Refinement and the zero-copy modes
+        // write from simulation memory that is changing by then.
+        int provided;
+        MPI_Query_thread(&provided);
+        paced = provided == MPI_THREAD_MULTIPLE && !settings.amr &&
+                !settings.adios_span && !settings.adios_memory_selection;
+        int rank;
+        MPI_Comm_rank(comm, &rank);
+        if (!paced && !rank)
+        {
+            std::cout << "paced_flush needs MPI_THREAD_MULTIPLE and is not "
+                         "combined with amr, adios_span or "
+                         "adios_memory_selection, writing synchronously"
+                      << std::endl;
+        }
+    }
+    if (settings.direct_io_block)
+    {
+        // BP5 writes its buffers with O_DIRECT at offsets and sizes of
+        // whole blocks
+        const std::string block = std::to_string(settings.direct_io_block);
+        io.SetParameter("DirectIO", "true");
+        io.SetParameter("DirectIOAlignOffset", block);
+        io.SetParameter("DirectIOAlignBuffer", block);
+    }
+
+    segment_steps = 0;
+    if (settings.output_rollover_steps > 0)
+    {
+        segment_steps = std::max(1, settings.output_rollover_steps /
+                                        settings.plotgap);
+    }
+    if (settings.output_rollover_gb > 0.0)
+    {
+        // U and V of an output step on average, with their cadences
+        double fields = 0.0;
+        if (settings.output_u_every > 0)
+        {
+            fields += 1.0 / settings.output_u_every;
+        }
+        if (settings.output_v_every > 0)
+        {
+            fields += 1.0 / settings.output_v_every;
+        }
+        const double step_bytes =
+            std::max(fields, 1e-6) * sizeof(double) * settings.L *
+            settings.L * settings.L * settings.members();
+        const size_t k = std::max<size_t>(
+            1, static_cast<size_t>(settings.output_rollover_gb * 1024.0 *
+                                   1024.0 * 1024.0 / step_bytes));
+        segment_steps = segment_steps ? std::min(segment_steps, k) : k;
+    }
+    if (segment_steps)
+    {
+        // Segments are opened by begin_step. A restart starts a new segment
+        // and lists it after those of the previous run.
+        segment_written = 0;
+        if (append)
+        {
+            trim_index(restart_step);
+        }
+        else
+        {
+            write_index("", true);
+        }
+        return;
+    }
+
     adios2::Mode mode = adios2::Mode::Write;
     if (append)
     {
         mode = adios2::Mode::Append;
     }
-    writer = io.Open(fname, mode);
+    writer = io.Open(fname, mode, comm);
 }
 
 void Writer::write(int step, const GrayScott &sim)
 {
+    // The previous step must be out before its staging buffers are
+    // refilled
+    wait();
+    put_u = settings.output_u_at(step);
+    put_v = settings.output_v_at(step);
+
     if (!sim.size_x || !sim.size_y || !sim.size_z)
     {
-        writer.BeginStep();
-        writer.EndStep();
+        begin_step(step);
+        end_step();
+        return;
+    }
+
+    if (paced)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (last_write.time_since_epoch().count())
+        {
+            write_interval =
+                std::chrono::duration<double>(now - last_write).count();
+        }
+        last_write = now;
+
+        const size_t n = sim.size_x * sim.size_y * sim.size_z;
+        sim.u_noghost(put_u ? staging_u.get(n, settings.direct_io_block)
+                            : nullptr,
+                      slices_u);
+        sim.v_noghost(put_v ? staging_v.get(n, settings.direct_io_block)
+                            : nullptr,
+                      slices_v);
+
+        // Leave a fifth of the interval as margin before the next step
+        flusher = std::thread(&Writer::paced_flush, this, step,
+                              adios2::Dims{sim.offset_z, sim.offset_y,
+                                           sim.offset_x},
+                              adios2::Dims{sim.size_z, sim.size_y, sim.size_x},
+                              0.8 * write_interval);
         return;
     }
 
+    // The block moves when the simulation rebalances
+    const adios2::Box<adios2::Dims> selection = {
+        dims(sim.offset_z, sim.offset_y, sim.offset_x, settings.member),
+        dims(sim.size_z, sim.size_y, sim.size_x, 1)};
+    var_u.SetSelection(selection);
+    var_v.SetSelection(selection);
+
     if (settings.adios_memory_selection)
     {
-        const std::vector<double> &u = sim.u_ghost();
-        const std::vector<double> &v = sim.v_ghost();
+        const adios2::Box<adios2::Dims> memory = {
+            dims(1, 1, 1, 0),
+            dims(sim.size_z + 2, sim.size_y + 2, sim.size_x + 2, 1)};
+        var_u.SetMemorySelection(memory);
+        var_v.SetMemorySelection(memory);
+
+        const GrayScott::Field &u = sim.u_ghost();
+        const GrayScott::Field &v = sim.v_ghost();
+        if (!slices_u.empty())
+        {
+            sim.u_noghost(nullptr, slices_u);
+            sim.v_noghost(nullptr, slices_v);
+        }
 
-        writer.BeginStep();
+        begin_step(step);
         writer.Put<int>(var_step, &step);
-        writer.Put<double>(var_u, u.data());
-        writer.Put<double>(var_v, v.data());
-        writer.EndStep();
+        if (put_u)
+        {
+            writer.Put<double>(var_u, u.data());
+        }
+        if (put_v)
+        {
+            writer.Put<double>(var_v, v.data());
+        }
+        write_slices({sim.offset_z, sim.offset_y, sim.offset_x},
+                     {sim.size_z, sim.size_y, sim.size_x});
+        write_refinement(sim);
+        end_step();
     }
     else if (settings.adios_span)
     {
-        writer.BeginStep();
+        begin_step(step);
 
         writer.Put<int>(var_step, &step);
 
-        // provide memory directly from adios buffer
-        adios2::Variable<double>::Span u_span = writer.Put<double>(var_u);
-        adios2::Variable<double>::Span v_span = writer.Put<double>(var_v);
+        // provide memory directly from adios buffer and populate it, along
+        // with the slices
+        if (put_u)
+        {
+            adios2::Variable<double>::Span u_span = writer.Put<double>(var_u);
+            sim.u_noghost(u_span.data(), slices_u);
+        }
+        else if (!slices_u.empty())
+        {
+            sim.u_noghost(nullptr, slices_u);
+        }
+        if (put_v)
+        {
+            adios2::Variable<double>::Span v_span = writer.Put<double>(var_v);
+            sim.v_noghost(v_span.data(), slices_v);
+        }
+        else if (!slices_v.empty())
+        {
+            sim.v_noghost(nullptr, slices_v);
+        }
 
-        // populate spans
-        sim.u_noghost(u_span.data());
-        sim.v_noghost(v_span.data());
-
-        writer.EndStep();
+        write_slices({sim.offset_z, sim.offset_y, sim.offset_x},
+                     {sim.size_z, sim.size_y, sim.size_x});
+        write_refinement(sim);
+        end_step();
     }
     else
     {
-        std::vector<double> u = sim.u_noghost();
-        std::vector<double> v = sim.v_noghost();
+        const size_t n = sim.size_x * sim.size_y * sim.size_z;
 
-        writer.BeginStep();
+        begin_step(step);
         writer.Put<int>(var_step, &step);
-        writer.Put<double>(var_u, u.data());
-        writer.Put<double>(var_v, v.data());
-        writer.EndStep();
+        // One pass over the block gives U without ghosts and its slices
+        double *u = put_u ? staging_u.get(n, settings.direct_io_block)
+                          : nullptr;
+        if (u || !slices_u.empty())
+        {
+            sim.u_noghost(u, slices_u);
+        }
+        if (put_u)
+        {
+            writer.Put<double>(var_u, u);
+        }
+        double *v = put_v ? staging_v.get(n, settings.direct_io_block)
+                          : nullptr;
+        if (v || !slices_v.empty())
+        {
+            sim.v_noghost(v, slices_v);
+        }
+        if (put_v)
+        {
+            writer.Put<double>(var_v, v);
+        }
+        write_slices({sim.offset_z, sim.offset_y, sim.offset_x},
+                     {sim.size_z, sim.size_y, sim.size_x});
+        write_refinement(sim);
+        end_step();
+    }
+}
+
+void Writer::write(int step, const GrayScottBatch &sim)
+{
+    put_u = settings.output_u_at(step);
+    put_v = settings.output_v_at(step);
+    if (!sim.size_x || !sim.size_y || !sim.size_z)
+    {
+        begin_step(step);
+        end_step();
+        return;
+    }
+
+    const size_t W = sim.members();
+    const size_t n = sim.size_x * sim.size_y * sim.size_z;
+
+    begin_step(step);
+    writer.Put<int>(var_step, &step);
+    if (put_u)
+    {
+        double *u = staging_u.get(W * n, settings.direct_io_block);
+        sim.u_noghost(u);
+        writer.Put<double>(var_u, u);
+    }
+    if (put_v)
+    {
+        double *v = staging_v.get(W * n, settings.direct_io_block);
+        sim.v_noghost(v);
+        writer.Put<double>(var_v, v);
+    }
+    end_step();
+}
+
+void Writer::write(int step, const Block *blocks, size_t count)
+{
+    put_u = settings.output_u_at(step);
+    put_v = settings.output_v_at(step);
+    begin_step(step);
+    if (count)
+    {
+        writer.Put<int>(var_step, &step);
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        const Block &b = blocks[i];
+        const size_t n = b.size_x * b.size_y * b.size_z;
+        if (!n)
+        {
+            continue;
+        }
+        const adios2::Box<adios2::Dims> selection = {
+            dims(b.offset_z, b.offset_y, b.offset_x, settings.member),
+            dims(b.size_z, b.size_y, b.size_x, 1)};
+        var_u.SetSelection(selection);
+        var_v.SetSelection(selection);
+        if (put_u)
+        {
+            writer.Put<double>(var_u, b.data.data());
+        }
+        if (put_v)
+        {
+            writer.Put<double>(var_v, b.data.data() + n);
+        }
+    }
+    end_step();
+}
+
+void Writer::paced_flush(int step, adios2::Dims offset, adios2::Dims size,
+                         double budget)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const size_t plane = size[1] * size[2];
+    const size_t chunks = std::min(
+        static_cast<size_t>(std::max(1, settings.paced_flush_chunks)),
+        size[0]);
+
+    begin_step(step);
+    writer.Put<int>(var_step, &step, adios2::Mode::Sync);
+    write_slices(offset, size);
+    for (size_t c = 0; c < chunks; c++)
+    {
+        const size_t z0 = size[0] * c / chunks;
+        const size_t z1 = size[0] * (c + 1) / chunks;
+        const adios2::Box<adios2::Dims> selection = {
+            dims(offset[0] + z0, offset[1], offset[2], settings.member),
+            dims(z1 - z0, size[1], size[2], 1)};
+        var_u.SetSelection(selection);
+        var_v.SetSelection(selection);
+        if (put_u)
+        {
+            writer.Put<double>(var_u, staging_u.data.get() + z0 * plane,
+                               adios2::Mode::Sync);
+        }
+        if (put_v)
+        {
+            writer.Put<double>(var_v, staging_v.data.get() + z0 * plane,
+                               adios2::Mode::Sync);
+        }
+        // Out to storage now instead of all at EndStep
+        writer.PerformDataWrite();
+
+        if (budget > 0.0)
+        {
+            std::this_thread::sleep_until(
+                start + std::chrono::duration_cast<
+                            std::chrono::steady_clock::duration>(
+                            std::chrono::duration<double>(budget * (c + 1) /
+                                                          chunks)));
+        }
+    }
+    end_step();
+
+    flush_seconds.push_back(std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - start)
+                                .count());
+}
+
+double *Writer::Staging::get(size_t n, size_t block)
+{
+    // Page alignment without direct I/O
+    const size_t align = block ? block : 4096;
+    const size_t need = (n * sizeof(double) + align - 1) / align * align;
+    if (need > bytes)
+    {
+        void *p = nullptr;
+        if (posix_memalign(&p, align, need))
+        {
+            throw std::bad_alloc();
+        }
+        data.reset(static_cast<double *>(p));
+        bytes = need;
+        // The padding after the n values is never written
+        std::fill(data.get() + n, data.get() + need / sizeof(double), 0.0);
+    }
+    return data.get();
+}
+
+adios2::Box<adios2::Dims> Writer::slice_box(int axis,
+                                            const adios2::Dims &offset,
+                                            const adios2::Dims &size) const
+{
+    // The two axes other than axis, in (z, y, x) order
+    static const int other[3][2] = {{0, 1}, {0, 2}, {1, 2}};
+    const int a = other[axis][0];
+    const int b = other[axis][1];
+    adios2::Box<adios2::Dims> box = {{offset[a], offset[b]},
+                                     {size[a], size[b]}};
+    if (settings.members() > 1)
+    {
+        box.first.insert(box.first.begin(), settings.member);
+        box.second.insert(box.second.begin(), 1);
+    }
+    return box;
+}
+
+void Writer::write_slices(const adios2::Dims &offset,
+                          const adios2::Dims &size)
+{
+    // Only the ranks a plane passes through have a part of it
+    for (size_t i = 0; i < slices_u.size(); i++)
+    {
+        if (slices_u[i].data.empty())
+        {
+            continue;
+        }
+        const adios2::Box<adios2::Dims> box =
+            slice_box(slices_u[i].axis, offset, size);
+        var_u_slices[i].SetSelection(box);
+        var_v_slices[i].SetSelection(box);
+        writer.Put<double>(var_u_slices[i], slices_u[i].data.data());
+        writer.Put<double>(var_v_slices[i], slices_v[i].data.data());
+    }
+}
+
+adios2::Dims Writer::dims(size_t z, size_t y, size_t x, size_t m) const
+{
+    if (settings.members() > 1)
+    {
+        return {m, z, y, x};
+    }
+    return {z, y, x};
+}
+
+void Writer::write_refinement(const GrayScott &sim)
+{
+    // fine_boxes has no member column, ensemble runs only write the
+    // (restricted) coarse fields
+    if (!settings.amr || settings.members() > 1)
+    {
+        return;
+    }
+    const std::vector<Refinement::Patch> &patches =
+        sim.refinement().patches();
+    if (patches.empty())
+    {
+        return;
+    }
+
+    std::vector<uint64_t> boxes;
+    boxes.reserve(6 * patches.size());
+    for (const auto &p : patches)
+    {
+        boxes.push_back(sim.offset_z + p.z0 - 1);
+        boxes.push_back(sim.offset_y + p.y0 - 1);
+        boxes.push_back(sim.offset_x + p.x0 - 1);
+        boxes.push_back(p.z1 - p.z0);
+        boxes.push_back(p.y1 - p.y0);
+        boxes.push_back(p.x1 - p.x0);
+    }
+    var_fine_boxes.SetSelection({{}, {patches.size(), 6}});
+    writer.Put<uint64_t>(var_fine_boxes, boxes.data(), adios2::Mode::Sync);
+
+    // The patch blocks follow the order of the rows of fine_boxes
+    std::vector<double> buf;
+    for (const auto &p : patches)
+    {
+        const adios2::Dims count = {static_cast<size_t>(p.nz),
+                                    static_cast<size_t>(p.ny),
+                                    static_cast<size_t>(p.nx)};
+        buf.resize(p.nx * p.ny * p.nz);
+        // The patches of U and V follow the cadence of U and V
+        if (put_u)
+        {
+            var_u_fine.SetSelection({{}, count});
+            p.noghost(p.u, buf.data());
+            writer.Put<double>(var_u_fine, buf.data(), adios2::Mode::Sync);
+        }
+        if (put_v)
+        {
+            var_v_fine.SetSelection({{}, count});
+            p.noghost(p.v, buf.data());
+            writer.Put<double>(var_v_fine, buf.data(), adios2::Mode::Sync);
+        }
+    }
+}
+
+Writer::~Writer() { wait(); }
+
+void Writer::wait()
+{
+    if (flusher.joinable())
+    {
+        flusher.join();
+    }
+}
+
+void Writer::close()
+{
+    wait();
+    if (!segment_steps)
+    {
+        writer.Close();
+        return;
+    }
+    if (segment_written)
+    {
+        writer.Close();
     }
+    write_index("end", false);
 }
 
-void Writer::close() { writer.Close(); }
+void Writer::align_subfiles()
+{
+    int rank, procs;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &procs);
+
+    // U and V of all ranks in one output step, the blocks of the ranks
+    // differ by at most one plane
+    const double a = static_cast<double>(settings.output_alignment);
+    const double total = 2.0 * sizeof(double) * settings.L * settings.L *
+                         settings.L * settings.members();
+    const double per_rank = total / procs;
+
+    // BP5 starts the block of every rank in a subfile at a multiple of
+    // StripeSize. Ranks with at least a stripe of data are padded to whole
+    // stripes each, which makes any aggregator group a whole number of
+    // stripes, so the configured aggregation is kept.
+    io.SetParameter("AggregationType", "TwoLevelShm");
+    if (per_rank >= a)
+    {
+        io.SetParameter("StripeSize",
+                        std::to_string(settings.output_alignment));
+        if (!rank)
+        {
+            const double stripes = std::ceil(per_rank / a);
+            std::cout << "output alignment: " << settings.output_alignment
+                      << " bytes, padded per rank to " << stripes
+                      << " stripes per step, "
+                      << (stripes * a * procs - total) / total * 100
+                      << "% padding" << std::endl;
+        }
+        return;
+    }
+
+    // Smaller ones are packed at the default StripeSize and the aggregation
+    // is overridden, with the aggregator groups whose payload comes closest
+    // to whole stripes
+    // One subfile with less than a stripe in total
+    int aggregators = 1;
+    double gap = std::numeric_limits<double>::max();
+    for (int A = 1; A <= procs; A++)
+    {
+        if (procs % A || total / A < a)
+        {
+            continue;
+        }
+        // Fewest bytes short of whole stripes, the most aggregators on a tie
+        const double g = std::ceil(total / A / a) * a * A - total;
+        if (g <= gap)
+        {
+            gap = g;
+            aggregators = A;
+        }
+    }
+
+    io.SetParameter("StripeSize", "4096");
+    io.SetParameter("NumAggregators", std::to_string(aggregators));
+    io.SetParameter("NumSubFiles", std::to_string(aggregators));
+
+    if (!rank)
+    {
+        std::cout << "output alignment: " << settings.output_alignment
+                  << " bytes, coalesced into " << aggregators
+                  << " aggregators of " << total / aggregators / a
+                  << " stripes per step" << std::endl;
+    }
+}
+
+void Writer::begin_step(int step)
+{
+    if (segment_steps && !segment_written)
+    {
+        // name.bp -> name-<first step>-<last step>.bp
+        const int last =
+            std::min(step + static_cast<int>(segment_steps - 1) *
+                                settings.plotgap,
+                     settings.steps / settings.plotgap * settings.plotgap);
+        const std::string range =
+            "-" + std::to_string(step) + "-" + std::to_string(last);
+        const size_t dot = fname.rfind('.');
+        const size_t slash = fname.rfind('/');
+        std::string name = fname + range;
+        if (dot != std::string::npos && dot != 0 &&
+            (slash == std::string::npos || dot > slash + 1))
+        {
+            name = fname.substr(0, dot) + range + fname.substr(dot);
+        }
+
+        writer = io.Open(name, adios2::Mode::Write, comm);
+        write_index(std::to_string(step) + " " + std::to_string(last) + " " +
+                        name.substr(slash == std::string::npos ? 0
+                                                               : slash + 1),
+                    false);
+    }
+    writer.BeginStep();
+}
+
+void Writer::end_step()
+{
+    writer.EndStep();
+    if (segment_steps && ++segment_written == segment_steps)
+    {
+        // Close full segments right away, so readers can move on
+        writer.Close();
+        segment_written = 0;
+    }
+}
+
+void Writer::write_index(const std::string &line, bool truncate) const
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    if (rank)
+    {
+        return;
+    }
+    std::ofstream index(fname + ".index",
+                        truncate ? std::ios::trunc : std::ios::app);
+    if (!line.empty())
+    {
+        index << line << std::endl;
+    }
+}
+
+void Writer::trim_index(int restart_step) const
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    if (rank)
+    {
+        return;
+    }
+
+    // The end of the previous run and its segments after restart_step go,
+    // the restarted run writes those steps again. A segment that also holds
+    // later steps is cut by the number of output steps to read from it.
+    std::vector<std::string> kept;
+    {
+        std::ifstream index(fname + ".index");
+        std::string line;
+        while (std::getline(index, line))
+        {
+            std::istringstream entry(line);
+            int first, last;
+            std::string file;
+            if (!(entry >> first >> last >> file) || first > restart_step)
+            {
+                continue;
+            }
+            if (last > restart_step)
+            {
+                const int steps = (restart_step - first) / settings.plotgap + 1;
+                line = std::to_string(first) + " " +
+                       std::to_string(restart_step) + " " + file + " " +
+                       std::to_string(steps);
+            }
+            kept.push_back(line);
+        }
+    }
+    std::ofstream index(fname + ".index", std::ios::trunc);
+    for (const auto &line : kept)
+    {
+        index << line << std::endl;
+    }
+}
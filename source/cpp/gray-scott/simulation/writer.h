@@ -4,25 +4,132 @@
 #include <adios2.h>
 #include <mpi.h>
 
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../../gray-scott/simulation/gray-scott-batch.h"
 #include "../../gray-scott/simulation/gray-scott.h"
 #include "../../gray-scott/simulation/settings.h"
 
 class Writer
 {
 public:
+    // Box of the global U and V forwarded by a compute rank, with U and V
+    // without ghosts one after the other in data
+    struct Block
+    {
+        size_t offset_x = 0, offset_y = 0, offset_z = 0;
+        size_t size_x = 0, size_y = 0, size_z = 0;
+        std::vector<double> data;
+    };
+
     Writer(const Settings &settings, const GrayScott &sim, adios2::IO io);
-    void open(const std::string &fname, bool append);
+    // Output of the members batched in sim, settings.member is the first
+    Writer(const Settings &settings, const GrayScottBatch &sim,
+           adios2::IO io);
+    // Output of an I/O rank, which writes blocks of other ranks
+    Writer(const Settings &settings, adios2::IO io);
+    ~Writer();
+    // comm is the writing ranks. With output rollover the segments of fname
+    // are opened as the steps come. A restart_step > 0 appends to the output
+    // of the run restarted from that step.
+    void open(const std::string &fname, int restart_step, MPI_Comm comm);
     void write(int step, const GrayScott &sim);
+    void write(int step, const GrayScottBatch &sim);
+    void write(int step, const Block *blocks, size_t count);
     void close();
+    // With paced flush, wait until the last output step is drained
+    void wait();
+
+    // With paced flush, the seconds each output step took to drain in the
+    // background, complete after close()
+    const std::vector<double> &flush_times() const { return flush_seconds; }
 
 protected:
     Settings settings;
 
     adios2::IO io;
     adios2::Engine writer;
+    MPI_Comm comm;
+    std::string fname;
+
+    // Staging buffer for U or V without ghosts, aligned to and padded to a
+    // whole number of settings.direct_io_block bytes, kept across steps
+    struct Staging
+    {
+        std::unique_ptr<double, void (*)(void *)> data{nullptr, std::free};
+        size_t bytes = 0;
+        // Room for n values
+        double *get(size_t n, size_t block);
+    };
+    Staging staging_u, staging_v;
+
+    // Paced flush: the step being drained, and the time between the last
+    // two writes that the next drain is spread over
+    bool paced = false;
+    std::thread flusher;
+    std::chrono::steady_clock::time_point last_write;
+    double write_interval = 0.0;
+    std::vector<double> flush_seconds;
+
+    // Whether U and V go into the step being written, see
+    // Settings::output_u_at
+    bool put_u = true;
+    bool put_v = true;
+
+    // settings.slice_axis/slice_index of U and V, filled by GrayScott with
+    // U and V without ghosts, and their 2D variables
+    std::vector<GrayScott::Slice> slices_u, slices_v;
+    std::vector<adios2::Variable<double>> var_u_slices, var_v_slices;
+
+    // Output rollover: output steps per segment (0 = one file), and output
+    // steps written to the open segment
+    size_t segment_steps = 0;
+    size_t segment_written = 0;
     adios2::Variable<double> var_u;
     adios2::Variable<double> var_v;
     adios2::Variable<int> var_step;
+    // Refined patches: one local array block per patch, and one row of
+    // fine_boxes per patch with its coarse global start and count (z, y, x)
+    adios2::Variable<double> var_u_fine;
+    adios2::Variable<double> var_v_fine;
+    adios2::Variable<uint64_t> var_fine_boxes;
+
+    // Attributes and U, V, step for the block of sim, holding count members.
+    // ghosted when write() Puts straight from the arrays of sim with ghosts
+    // under adios_memory_selection, not from ghost-free staging.
+    template <class Sim>
+    void define_variables(const Sim &sim, size_t count, bool ghosted);
+    // Dimensions (z, y, x), with the ensemble member m in front in an
+    // ensemble run
+    adios2::Dims dims(size_t z, size_t y, size_t x, size_t m) const;
+    // Set the aggregation of the engine so subfile writes are whole
+    // multiples of settings.output_alignment
+    void align_subfiles();
+    // BeginStep/EndStep of the output, opening and closing segments with
+    // output rollover
+    void begin_step(int step);
+    void end_step();
+    // Append a line to the segment index fname.index, on rank 0 of comm
+    void write_index(const std::string &line, bool truncate) const;
+    // Drop what follows restart_step from the index, on rank 0 of comm
+    void trim_index(int restart_step) const;
+    // Write the block of U and V in staging_u/v as one output step in
+    // slabs of z planes, each flushed to storage and taking budget /
+    // paced_flush_chunks seconds. Runs in flusher.
+    void paced_flush(int step, adios2::Dims offset, adios2::Dims size,
+                     double budget);
+    // Start and count of the block at offset with size (z, y, x) in the 2D
+    // array of a slice along axis
+    adios2::Box<adios2::Dims> slice_box(int axis, const adios2::Dims &offset,
+                                        const adios2::Dims &size) const;
+    // Put the parts of the slices in the block at offset with size
+    void write_slices(const adios2::Dims &offset, const adios2::Dims &size);
+    // Put the refined patches of this rank in the current step
+    void write_refinement(const GrayScott &sim);
 };
 
 #endif
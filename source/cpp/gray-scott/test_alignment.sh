@@ -0,0 +1,59 @@
+#!/bin/bash
+
+# Local filesystem benchmark for output_alignment: runs the simulation with
+# and without alignment and reports how much of each subfile is made of
+# whole stripes, and the write time of each run.
+#
+# Usage: ./test_alignment.sh [processes] [L] [alignment bytes] [directory]
+
+NP=${1:-4}
+L=${2:-64}
+ALIGN=${3:-4194304}
+DIR=${4:-/tmp/gray-scott-alignment}
+
+GS=./build/adios2-gray-scott
+if [ ! -x "$GS" ]; then
+    echo "Error: $GS not found, build the examples first"
+    exit 1
+fi
+
+mkdir -p "$DIR"
+
+source "$(dirname "$0")/benchmark_settings.sh"
+
+run() {
+    local name=$1
+    local alignment=$2
+    local settings="$DIR/settings-$name.json"
+    write_settings "$settings" "$L" 100 10 "$DIR/gs-$name.bp" \
+        "\"output_alignment\": $alignment"
+    rm -rf "$DIR/gs-$name.bp"
+    echo ""
+    echo "Run $name: output_alignment = $alignment"
+    echo "----------------------------------------"
+    mpirun -n "$NP" "$GS" "$settings" | grep -E "output alignment|I/O write time|Write throughput"
+
+    # Every step appends whole stripes to an aligned subfile
+    local aligned=0
+    local total=0
+    for f in "$DIR/gs-$name.bp"/data.*; do
+        [ -f "$f" ] || continue
+        local size
+        size=$(stat -c %s "$f")
+        total=$((total + 1))
+        if [ $((size % ALIGN)) -eq 0 ]; then
+            aligned=$((aligned + 1))
+        fi
+        printf "  %-12s %12d bytes  %8.2f stripes\n" "$(basename "$f")" \
+            "$size" "$(echo "scale=2; $size / $ALIGN" | bc)"
+    done
+    echo "  Subfiles of whole stripes: $aligned of $total"
+}
+
+echo "========================================"
+echo "Gray-Scott output alignment benchmark"
+echo "$NP processes, L = $L, alignment $ALIGN bytes, in $DIR"
+echo "========================================"
+
+run unaligned 0
+run aligned "$ALIGN"
@@ -0,0 +1,59 @@
+#!/bin/bash
+
+# Page cache use of the output with and without direct_io_block, on a local
+# block-backed filesystem (e.g. an ext4 image mounted through a loop device,
+# or the mapped RBD device). The page cache is dropped before each run when
+# running as root.
+#
+# Usage: ./test_direct_io.sh [processes] [L] [block bytes] [directory]
+
+NP=${1:-4}
+L=${2:-128}
+BLOCK=${3:-4096}
+DIR=${4:-/tmp/gray-scott-direct-io}
+
+GS=./build/adios2-gray-scott
+if [ ! -x "$GS" ]; then
+    echo "Error: $GS not found, build the examples first"
+    exit 1
+fi
+
+mkdir -p "$DIR"
+
+source "$(dirname "$0")/benchmark_settings.sh"
+
+cached_kb() {
+    awk '/^Cached:/ {print $2}' /proc/meminfo
+}
+
+run() {
+    local name=$1
+    local block=$2
+    local settings="$DIR/settings-$name.json"
+    write_settings "$settings" "$L" 100 10 "$DIR/gs-$name.bp" \
+        "\"direct_io_block\": $block"
+    rm -rf "$DIR/gs-$name.bp"
+    sync
+    if [ "$(id -u)" -eq 0 ]; then
+        echo 1 > /proc/sys/vm/drop_caches
+    fi
+
+    echo ""
+    echo "Run $name: direct_io_block = $block"
+    echo "----------------------------------------"
+    local before
+    before=$(cached_kb)
+    mpirun -n "$NP" "$GS" "$settings" | grep -E "I/O write time|Write throughput"
+    local after
+    after=$(cached_kb)
+    echo "  Output size:            $(du -sh "$DIR/gs-$name.bp" | cut -f1)"
+    echo "  Page cache growth:      $(((after - before) / 1024)) MB"
+}
+
+echo "========================================"
+echo "Gray-Scott direct I/O benchmark"
+echo "$NP processes, L = $L, block $BLOCK bytes, in $DIR"
+echo "========================================"
+
+run buffered 0
+run direct "$BLOCK"
@@ -4,6 +4,8 @@
 
 #include "gray-scott.h"
 
+#include "../../common/block-decomp.hpp"
+
 #include <mpi.h>
 #include <stdexcept> // runtime_error
 #include <vector>
@@ -224,26 +226,15 @@ void GrayScott::init_mpi()
     py = coords[1];
     pz = coords[2];
 
-    size_x = settings.L / npx;
-    size_y = settings.L / npy;
-    size_z = settings.L / npz;
-
-    if (px < settings.L % npx)
-    {
-        size_x++;
-    }
-    if (py < settings.L % npy)
-    {
-        size_y++;
-    }
-    if (pz < settings.L % npz)
-    {
-        size_z++;
-    }
-
-    offset_x = (settings.L / npx * px) + std::min(settings.L % npx, px);
-    offset_y = (settings.L / npy * py) + std::min(settings.L % npy, py);
-    offset_z = (settings.L / npz * pz) + std::min(settings.L % npz, pz);
+    const decomp::Block block =
+        decomp::block({settings.L, settings.L, settings.L}, {npx, npy, npz},
+                      {px, py, pz});
+    size_x = block.count[0];
+    size_y = block.count[1];
+    size_z = block.count[2];
+    offset_x = block.start[0];
+    offset_y = block.start[1];
+    offset_z = block.start[2];
 
     MPI_Cart_shift(cart_comm, 0, 1, &west, &east);
     MPI_Cart_shift(cart_comm, 1, 1, &down, &up);